@@ -5,8 +5,7 @@
 
 #include "utils.h"
 #include "ad.h"
-
-Domain *symTable=NULL;
+#include "intern.h"
 
 int typeBaseSize(Type *t){
 	switch(t->tb){
@@ -14,13 +13,8 @@ int typeBaseSize(Type *t){
 		case TB_DOUBLE:return sizeof(double);
 		case TB_CHAR:return sizeof(char);
 		case TB_VOID:return 0;
-		default:{		// TB_STRUCT
-			int size=0;
-			for(Symbol *m=t->s->structMembers;m;m=m->next){
-				size+=typeSize(&m->type);
-				}
-			return size;
-			}
+		default:		// TB_STRUCT
+			return t->s->structSize;
 		}
 	}
 
@@ -30,28 +24,59 @@ int typeSize(Type *t){
 	return t->n*typeBaseSize(t);
 	}
 
-// free from memory a list of symbols
-void freeSymbols(Symbol *list){
-	for(Symbol *next;list;list=next){
-		next=list->next;
-		freeSymbol(list);
+int typeAlign(Type *t){
+	if(t->n==0)return _Alignof(void*);
+	switch(t->tb){
+		case TB_INT:return _Alignof(int);
+		case TB_DOUBLE:return _Alignof(double);
+		case TB_STRUCT:return t->s->structAlign;
+		default:return 1;
+		}
+	}
+
+void layoutStruct(Symbol *s){
+	int size=0,align=1,n=0;
+	for(Symbol *m=s->structMembers;m;m=m->next){
+		int a=typeAlign(&m->type);
+		size=(size+a-1)/a*a;
+		m->varIdx=size;
+		size+=typeSize(&m->type);
+		if(a>align)align=a;
+		n++;
+		}
+	s->structSize=(size+align-1)/align*align;
+	s->structAlign=align;
+	// at most half of the slots are used, so a search ends quickly on an empty slot
+	unsigned cap=4;
+	while(cap<2*(unsigned)n)cap*=2;
+	s->structIndex=(Symbol**)arenaAlloc(&s->domain->lasting,cap*sizeof(Symbol*));
+	memset(s->structIndex,0,cap*sizeof(Symbol*));
+	s->structIndexMask=cap-1;
+	for(Symbol *m=s->structMembers;m;m=m->next){
+		unsigned i=internHash(m->name)&s->structIndexMask;
+		while(s->structIndex[i])i=(i+1)&s->structIndexMask;
+		s->structIndex[i]=m;
+		}
+	}
+
+Symbol *findStructMember(Symbol *s,const char *name){
+	unsigned i=internHash(name)&s->structIndexMask;
+	for(Symbol *m;(m=s->structIndex[i]);i=(i+1)&s->structIndexMask){
+		if(m->name==name)return m;
 		}
+	return NULL;
 	}
 
-Symbol *newSymbol(const char *name,SymKind kind){
-	Symbol *s=(Symbol*)safeAlloc(sizeof(Symbol));
-	// sets all the fields to 0/NULL
+Symbol *allocSymbol(Arena *a,const char *name,SymKind kind){
+	Symbol *s=(Symbol*)arenaAlloc(a,sizeof(Symbol));
 	memset(s,0,sizeof(Symbol));
 	s->name=name;
 	s->kind=kind;
 	return s;
 	}
 
-Symbol *dupSymbol(Symbol *symbol){
-	Symbol *s=(Symbol*)safeAlloc(sizeof(Symbol));
-	*s=*symbol;
-	s->next=NULL;
-	return s;
+Symbol *newSymbol(SymTable *st,const char *name,SymKind kind){
+	return allocSymbol(&st->arena,name,kind);
 	}
 
 // s->next is already NULL from newSymbol
@@ -72,38 +97,92 @@ int symbolsLen(Symbol *list){
 	return n;
 	}
 
-void freeSymbol(Symbol *s){
-	switch(s->kind){
-		case SK_VAR:
-			if(!s->owner)free(s->varMem);
-			break;
-		case SK_FN:
-			freeSymbols(s->fn.params);
-			freeSymbols(s->fn.locals);
-			break;
-		case SK_STRUCT:
-			freeSymbols(s->structMembers);
-			break;
-		case SK_PARAM:
-			// nothing to free
-			break;
+void symTableInit(SymTable *st,const SymTable *base){
+	st->top=NULL;
+	st->base=base;
+	st->bindings=NULL;
+	st->bindingsCap=st->nBindings=0;
+	memset(&st->arena,0,sizeof(Arena));
+	}
+
+void symTableFree(SymTable *st){
+	free(st->bindings);
+	arenaFree(&st->arena);
+	symTableInit(st,st->base);
+	}
+
+// returns the slot of name or, if name is not in the table, the free slot where it can be added
+static Binding *findBinding(const SymTable *st,const char *name){
+	unsigned mask=st->bindingsCap-1;
+	Binding *b=&st->bindings[internHash(name)&mask];
+	while(b->name&&b->name!=name){
+		b=b==&st->bindings[mask]?st->bindings:b+1;
+		}
+	return b;
+	}
+
+// doubles the table and reinserts all the bindings
+static void growBindings(SymTable *st){
+	Binding *old=st->bindings;
+	unsigned oldCap=st->bindingsCap;
+	st->bindingsCap=oldCap?oldCap*2:256;
+	st->bindings=(Binding*)safeAlloc(st->bindingsCap*sizeof(Binding));
+	memset(st->bindings,0,st->bindingsCap*sizeof(Binding));
+	for(unsigned i=0;i<oldCap;i++){
+		if(old[i].name)*findBinding(st,old[i].name)=old[i];
+		}
+	free(old);
+	}
+
+// makes s the visible symbol of its name
+static void bindSymbol(SymTable *st,Symbol *s){
+	if(2*(st->nBindings+1)>st->bindingsCap)growBindings(st);
+	Binding *b=findBinding(st,s->name);
+	if(!b->name){
+		b->name=s->name;
+		st->nBindings++;
 		}
-	free(s);
+	s->shadowed=b->sym;
+	b->sym=s;
 	}
 
-Domain *pushDomain(){
-	Domain *d=(Domain*)safeAlloc(sizeof(Domain));
-	d->symbols=NULL;
-	d->parent=symTable;
-	symTable=d;
+Domain *pushDomain(SymTable *st){
+	ArenaMark mark=arenaMark(&st->arena);
+	Domain *d=(Domain*)arenaAlloc(&st->arena,sizeof(Domain));
+	d->symbols=d->last=NULL;
+	d->nSymbols=0;
+	d->mark=mark;
+	memset(&d->lasting,0,sizeof(Arena));
+	d->parent=st->top;
+	st->top=d;
+	return d;
+	}
+
+Domain *detachDomain(SymTable *st){
+	Domain *d=st->top;
+	st->top=d->parent;
+	// the symbols of d are the innermost ones of their names
+	for(Symbol *s=d->symbols;s;s=s->nextInDomain){
+		findBinding(st,s->name)->sym=s->shadowed;
+		}
 	return d;
 	}
 
-void dropDomain(){
-	Domain *d=symTable;
-	symTable=d->parent;
-	freeSymbols(d->symbols);
-	free(d);
+void attachDomain(SymTable *st,Domain *d){
+	d->parent=st->top;
+	st->top=d;
+	for(Symbol *s=d->symbols;s;s=s->nextInDomain)bindSymbol(st,s);
+	}
+
+void freeDomain(Domain *d){
+	arenaFree(&d->lasting);
+	}
+
+void dropDomain(SymTable *st){
+	Domain *d=detachDomain(st);
+	ArenaMark mark=d->mark;
+	freeDomain(d);
+	arenaRelease(&st->arena,mark);
 	}
 
 void showNamedType(Type *t,const char *name){
@@ -163,43 +242,53 @@ void showSymbol(Symbol *s){
 
 void showDomain(Domain *d,const char *name){
 	printf("// domain: %s\n",name);
-	for(Symbol *s=d->symbols;s;s=s->next){
+	for(Symbol *s=d->symbols;s;s=s->nextInDomain){
 		showSymbol(s);
 		}
 	puts("\n");
 	}
 
-Symbol *findSymbolInDomain(Domain *d,const char *name){
-	for(Symbol *s=d->symbols;s;s=s->next){
-		if(!strcmp(s->name,name))return s;
-		}
-	return NULL;
+Symbol *findSymbolChain(const SymTable *st,const char *name){
+	if(!st->nBindings)return NULL;
+	return findBinding(st,name)->sym;
+	}
+
+Symbol *findSymbolInDomain(const SymTable *st,const char *name){
+	Symbol *s=findSymbolChain(st,name);
+	return s&&s->domain==st->top?s:NULL;
 	}
 
-Symbol *findSymbol(const char *name){
-	for(Domain *d=symTable;d;d=d->parent){
-		Symbol *s=findSymbolInDomain(d,name);
+Symbol *findSymbol(const SymTable *st,const char *name){
+	for(;st;st=st->base){
+		Symbol *s=findSymbolChain(st,name);
 		if(s)return s;
 		}
 	return NULL;
 	}
 
-Symbol *addSymbolToDomain(Domain *d,Symbol *s){
-	return addSymbolToList(&d->symbols,s);
+Symbol *addSymbolToDomain(SymTable *st,Symbol *s){
+	Domain *d=st->top;
+	s->domain=d;
+	s->defIdx=d->nSymbols++;
+	if(d->last)d->last->nextInDomain=s;
+		else d->symbols=s;
+	d->last=s;
+	bindSymbol(st,s);
+	return s;
 	}
 
-Symbol *addExtFn(const char *name,void(*extFnPtr)(),Type ret){
-	Symbol *fn=newSymbol(name,SK_FN);
+Symbol *addExtFn(SymTable *st,const char *name,void(*extFnPtr)(),Type ret){
+	Symbol *fn=newSymbol(st,name,SK_FN);
 	fn->fn.extFnPtr=extFnPtr;
 	fn->type=ret;
-	addSymbolToDomain(symTable,fn);
+	addSymbolToDomain(st,fn);
 	return fn;
 	}
 
 Symbol *addFnParam(Symbol *fn,const char *name,Type type){
-	Symbol *param=newSymbol(name,SK_PARAM);
+	Symbol *param=allocSymbol(&fn->domain->lasting,name,SK_PARAM);
 	param->type=type;
+	param->owner=fn;
 	param->paramIdx=symbolsLen(fn->fn.params);
-	addSymbolToList(&fn->fn.params,dupSymbol(param));
-	return param;
+	return addSymbolToList(&fn->fn.params,param);
 	}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vm.h" // Include the header file where Instr is defined
+#include "utils.h"
 
 // the domain analysis
 
@@ -23,13 +24,17 @@ typedef struct{		// the type of a symbol
 
 // returns the size of type t in bytes
 int typeSize(Type *t);
+// returns the alignment of type t in bytes
+int typeAlign(Type *t);
+// shows the type t, followed by name if it is not NULL
+void showNamedType(Type *t,const char *name);
 
 typedef enum{		// symbol's kind
 	SK_VAR,SK_PARAM,SK_FN,SK_STRUCT
 	}SymKind;
 
 struct Symbol{
-	const char *name;		// symbol's name. The symbol doesn't own this pointer, but it is allocated somewhere else (ex: in Token)
+	const char *name;		// symbol's name. It must be an interned name (see intern.h), so the names are compared by pointer
 	SymKind kind;
 	Type type;
 
@@ -38,62 +43,124 @@ struct Symbol{
 	//		- a struct for variables defined in that struct
 	//		- a function for parameters/variables local to that function
 	Symbol *owner;
-	Symbol *next;		// the link to the next symbol in list
+	Symbol *next;		// the link to the next symbol in the list of its owner (params, locals or members)
+	// for the symbols of a domain:
+	Symbol *nextInDomain;		// the link to the next symbol of the same domain
+	struct _Domain *domain;		// the domain of the symbol
+	int defIdx;		// the position of the symbol in its domain, in the order of definition
+	Symbol *shadowed;		// the symbol with the same name from an outer domain, hidden by this one
 	union{		// specific data fo each kind of symbol
 		// the index in fn.locals for local vars
-		// the index in struct for struct members
+		// the offset in struct for struct members
 		int varIdx;
 		// the variable memory for global vars (dynamically allocated)
 		void *varMem;
 		// the index in fn.params for parameters
 		int paramIdx;
-		// the members of a struct
-		Symbol *structMembers;
+		struct{		// for structs
+			Symbol *structMembers;		// the members of a struct
+			// the layout, set by layoutStruct when the struct is complete
+			int structSize;		// including the padding at the end
+			int structAlign;		// the largest alignment of a member
+			// open addressing hash table of the members, by the internHash of their names
+			Symbol **structIndex;
+			unsigned structIndexMask;		// the number of slots - 1 (a power of 2 - 1)
+			};
 		struct{
 			Symbol *params;		// the parameters of a function
 			Symbol *locals;		// all local vars of a function, including the ones from its inner domains
-			void(*extFnPtr)();		// !=NULL for extern functions
+			void(*extFnPtr)();		// !=NULL for extern functions; it is called with the Vm* which runs the code
 			Instr *instr;		// used if extFnPtr==NULL
 			}fn;
 		};
 	};
 
-// dynamically allocation of a new symbol
-Symbol *newSymbol(const char *name,SymKind kind);
-// duplicates the given symbol
-Symbol *dupSymbol(Symbol *symbol);
+struct SymTable;
+
+// allocation of a new symbol for the current domain of st
+// it is freed when that domain is dropped
+Symbol *newSymbol(struct SymTable *st,const char *name,SymKind kind);
+// allocation of a new symbol in the arena a, for the symbols which remain after their domain is dropped
+Symbol *allocSymbol(Arena *a,const char *name,SymKind kind);
 // adds the symbol the the end of the list
 // list - the address of the list where to add the symbol
 Symbol *addSymbolToList(Symbol **list,Symbol *s);
 // the number of the symbols in list
 int symbolsLen(Symbol *list);
-// frees the memory of a symbol
-void freeSymbol(Symbol *s);
+// sets the offsets of the members of struct s and its size and alignment, and indexes the members by name
+// the members are aligned naturally and the size is padded to a multiple of the alignment
+// it is called when the struct is complete; the index is allocated in the lasting arena of the struct's domain
+void layoutStruct(Symbol *s);
+// returns the member of struct s with the given name, or NULL
+Symbol *findStructMember(Symbol *s,const char *name);
 
 typedef struct _Domain{
 	struct _Domain *parent;		// the parent domain
-	Symbol *symbols;		// the symbols from this domain (single linked list)
+	Symbol *symbols;		// the symbols from this domain (linked by nextInDomain), in the order of definition
+	Symbol *last;		// the last symbol from symbols
+	int nSymbols;		// the number of symbols from this domain
+	ArenaMark mark;		// the position of the table's arena before the domain was pushed
+	// the memory of the symbols owned by the functions and structs from this domain (parameters, locals, members)
+	// these symbols remain in the lists of their owners after their own domains are dropped, until this domain is dropped
+	Arena lasting;
 	}Domain;
 
-// the current domain (the top of the domains's stack)
-extern Domain *symTable;
-
+// a name and its visible symbol
+typedef struct{
+	const char *name;
+	Symbol *sym;		// the symbol from the innermost domain; the outer ones are linked by Symbol.shadowed
+	}Binding;
+
+// the symbols table of a compilation: a stack of domains
+// all the symbols of the stack are in a single hash table, in which each name has a chain with its symbols,
+// from the innermost domain outward, so a search is a single lookup, regardless of the number of domains
+// the symbols of a domain are its undo log: when the domain is dropped, they are removed from their chains
+// each compilation has its own table, so many compilations can run in parallel
+typedef struct SymTable{
+	Domain *top;		// the current domain (the top of the domains's stack)
+	// the names which are not in this table are searched in base; NULL for no base
+	// a base must not change while other tables use it, so it can be shared by the tables of many threads
+	const struct SymTable *base;
+	Binding *bindings;		// open addressing hash table, by the internHash of the names
+	unsigned bindingsCap;		// the number of slots in bindings (a power of 2)
+	unsigned nBindings;		// the number of used slots; a slot remains used after its chain becomes empty
+	// the memory of the domains and of their symbols, used as a stack: when a domain is dropped,
+	// all the memory allocated after it was pushed is released at once
+	Arena arena;
+	}SymTable;
+
+// initializes an empty table over base
+void symTableInit(SymTable *st,const SymTable *base);
+// frees the table, which must have no domains
+void symTableFree(SymTable *st);
 // adds a domain to the top of the domains's stack
-Domain *pushDomain();
+Domain *pushDomain(SymTable *st);
 // deletes the domain from the top of the domains's stack
-void dropDomain();
+void dropDomain(SymTable *st);
+// removes the domain from the top of the domains's stack, without deleting it or its symbols
+// their memory remains in the arena of st until the domain under it is dropped
+Domain *detachDomain(SymTable *st);
+// puts on the top of the domains's stack a domain removed before with detachDomain (possibly from another table)
+// it must be detached again before it is dropped, because its memory is not from the arena of st
+void attachDomain(SymTable *st,Domain *d);
+// frees the lasting memory of a detached domain
+void freeDomain(Domain *d);
 // shows the content of the given domain
 void showDomain(Domain *d,const char *name);
-// search a symbol with the given name in the specified domain and returns it
+// search a symbol with the given name in the current domain of st and returns it
 // if no symbol find, returns NULL
-Symbol *findSymbolInDomain(Domain *d,const char *name);
-// searches a symbol in all domains, starting with the current one
-Symbol *findSymbol(const char *name);
-// adds a symbol to the current domain
-Symbol *addSymbolToDomain(Domain *d,Symbol *s);
-
-// add in ST an extern function with the given name, address and return type
-Symbol *addExtFn(const char *name,void(*extFnPtr)(),Type ret);
+// all the functions which search by name expect an interned name
+Symbol *findSymbolInDomain(const SymTable *st,const char *name);
+// searches a symbol in all domains, starting with the current one, then in the bases of st
+Symbol *findSymbol(const SymTable *st,const char *name);
+// returns the symbol with the given name from the innermost domain of st, without searching in the bases
+// the symbols from the outer domains follow it in the Symbol.shadowed chain
+Symbol *findSymbolChain(const SymTable *st,const char *name);
+// adds a symbol to the current domain of st and sets its defIdx
+Symbol *addSymbolToDomain(SymTable *st,Symbol *s);
+
+// add in the current domain of st an extern function with the given name, address and return type
+Symbol *addExtFn(SymTable *st,const char *name,void(*extFnPtr)(),Type ret);
 
 // add to fn a parameter with the given name and type
 // it doesn't verify for parameter redefinition
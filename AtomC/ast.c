@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "ast.h"
+
+static const char *kindNames[]={
+	"unit","struct","fn","var","param",
+	"block","if","while","return","expr",
+	"=","||","&&","==","!=","<","<=",">",">=",
+	"+","-","*","/",
+	"neg","!","cast","[]",".","call","id",
+	"int","double","char","string"
+	};
+
+NodeId astNew(Ast *a,NodeKind kind,int line){
+	if(a->n==0)a->n=1;		// node 0 is not used
+	if(a->n>=a->cap){
+		a->cap=a->cap?a->cap*2:1024;
+		a->nodes=(Node*)safeRealloc(a->nodes,a->cap*sizeof(Node));
+		}
+	Node *node=&a->nodes[a->n];
+	node->kind=(uint8_t)kind;
+	node->lval=node->ct=false;
+	node->line=line;
+	node->first=node->next=0;
+	node->tb=TB_VOID;
+	node->n=-1;
+	node->sym=NULL;
+	return a->n++;
+	}
+
+// true if the node of this kind refers to a symbol
+static bool hasSym(int kind){
+	switch(kind){
+		case N_STRUCT:case N_FN:case N_VAR:case N_PARAM:case N_FIELD:case N_CALL:case N_ID:return true;
+		default:return false;
+		}
+	}
+
+Type astType(Ast *a,NodeId n){
+	Node *node=&a->nodes[n];
+	Type t={(TypeBase)node->tb,NULL,node->n};
+	if(t.tb==TB_STRUCT)t.s=hasSym(node->kind)?node->sym->type.s:node->s;
+	return t;
+	}
+
+void astSetType(Ast *a,NodeId n,const Type *t){
+	Node *node=&a->nodes[n];
+	node->tb=(uint8_t)t->tb;
+	node->n=t->n;
+	if(t->tb==TB_STRUCT&&!hasSym(node->kind))node->s=t->s;
+	}
+
+void astAppend(Ast *a,NodeId parent,NodeId *last,NodeId child){
+	if(*last)a->nodes[*last].next=child;
+		else a->nodes[parent].first=child;
+	*last=child;
+	}
+
+int astCopy(Ast *dst,const Ast *src,NodeId from,NodeId to){
+	if(dst->n==0)dst->n=1;
+	int delta=dst->n-from;
+	if(dst->n+(to-from)>dst->cap){
+		while(dst->n+(to-from)>dst->cap)dst->cap=dst->cap?dst->cap*2:1024;
+		dst->nodes=(Node*)safeRealloc(dst->nodes,dst->cap*sizeof(Node));
+		}
+	Node *node=&dst->nodes[dst->n];
+	memcpy(node,&src->nodes[from],(to-from)*sizeof(Node));
+	for(int i=0;i<to-from;i++,node++){
+		if(node->first)node->first+=delta;
+		if(node->next)node->next+=delta;
+		}
+	dst->n+=to-from;
+	return delta;
+	}
+
+void astClear(Ast *a){
+	a->n=0;
+	a->root=0;
+	}
+
+void astFree(Ast *a){
+	free(a->nodes);
+	a->nodes=NULL;
+	a->n=a->cap=0;
+	a->root=0;
+	}
+
+void showAst(Ast *a,NodeId n,int depth){
+	Node *node=&a->nodes[n];
+	printf("%*s%s",depth*2,"",kindNames[node->kind]);
+	switch(node->kind){
+		case N_STRUCT:case N_FN:case N_VAR:case N_PARAM:case N_FIELD:case N_CALL:case N_ID:
+			printf(" %s",node->sym->name);
+			break;
+		case N_INT:printf(" %d",node->i);break;
+		case N_DOUBLE:printf(" %g",node->d);break;
+		case N_CHAR:printf(" '%c'",node->c);break;
+		case N_STRING:printf(" \"%s\"",node->text);break;
+		}
+	if(node->kind>=N_ASSIGN||node->kind==N_VAR||node->kind==N_PARAM||node->kind==N_FN){
+		Type t=astType(a,n);
+		printf(" : ");
+		showNamedType(&t,NULL);
+		}
+	printf("\t// line %d\n",node->line);
+	for(NodeId c=node->first;c;c=a->nodes[c].next){
+		showAst(a,c,depth+1);
+		}
+	}
@@ -0,0 +1,87 @@
+#pragma once
+
+// the abstract syntax tree built by the parser
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ad.h"
+
+typedef enum{		// node's kind
+	// definitions
+	N_UNIT,		// the children are the definitions, in source order
+	N_STRUCT,		// sym - the struct; the children are its members (N_VAR)
+	N_FN,		// sym - the function; the children are its parameters (N_PARAM), then its body (N_BLOCK)
+	N_VAR,		// sym - the variable
+	N_PARAM,		// sym - the parameter
+	// statements
+	N_BLOCK,		// the children are the local variables (N_VAR) and the statements, in source order
+	N_IF,		// the children: condition, then statement, optional else statement
+	N_WHILE,		// the children: condition, statement
+	N_RETURN,		// the child is the optional returned expression
+	N_EXPR,		// an expression statement; the child is the optional expression
+	// expressions; their type, lval and ct are the ones computed by the types analysis
+	N_ASSIGN,		// the children: destination, source
+	N_OR,N_AND,N_EQUAL,N_NOTEQ,N_LESS,N_LESSEQ,N_GREATER,N_GREATEREQ,
+	N_ADD,N_SUB,N_MUL,N_DIV,		// the binary operators have 2 children
+	N_NEG,N_NOT,		// the child is the operand
+	N_CAST,		// type - the destination type; the child is the operand
+	N_INDEX,		// the children: array, index
+	N_FIELD,		// sym - the struct member; the child is the struct
+	N_CALL,		// sym - the function; the children are the arguments
+	N_ID,		// sym - the variable or parameter
+	N_INT,N_DOUBLE,N_CHAR,N_STRING
+	}NodeKind;
+
+// a node is referred by its index in Ast.nodes, so the nodes can be moved when the array grows
+// 0 is not a valid node, so it is used for "no node"
+typedef int NodeId;
+
+// a node has 32 bytes, so its Type is stored in parts (see astType)
+typedef struct{
+	uint8_t kind;		// NodeKind
+	uint8_t tb;		// the TypeBase of the node's type
+	bool lval;		// for expressions, true if left-value
+	bool ct;		// for expressions, true if constant
+	int line;		// the line of the first token of the node
+	NodeId first;		// the first child
+	NodeId next;		// the next sibling
+	int n;		// the array dimension of the node's type
+	union{
+		// the referred symbol is one which remains valid after its domain is dropped:
+		// for locals, parameters and struct members, the symbol from their owner's list
+		Symbol *sym;
+		// the struct of a TB_STRUCT type, for the nodes without sym
+		// for the nodes with sym, it is the one from sym's type
+		Symbol *s;
+		int i;		// N_INT
+		double d;		// N_DOUBLE
+		char c;		// N_CHAR
+		const char *text;		// N_STRING
+		};
+	}Node;
+
+// the nodes are allocated by bumping n in a single array, and they are all freed at once
+typedef struct{
+	Node *nodes;
+	int n;		// the number of used nodes, including the unused node 0
+	int cap;
+	NodeId root;
+	}Ast;
+
+// adds a new node without children
+NodeId astNew(Ast *a,NodeKind kind,int line);
+// returns the type of the node n: for expressions, their type; for definitions, the declared type
+Type astType(Ast *a,NodeId n);
+// sets the type of the node n; for the nodes with sym, it must be set before
+void astSetType(Ast *a,NodeId n,const Type *t);
+// adds child after *last, the last child of parent (0 if parent has no children yet), and updates *last
+void astAppend(Ast *a,NodeId parent,NodeId *last,NodeId child);
+// adds at the end of dst a copy of the nodes [from,to) of src, which must refer only to each other
+// returns the value which is added to their ids, so the copy of the node n is n+returned value
+int astCopy(Ast *dst,const Ast *src,NodeId from,NodeId to);
+// drops all the nodes, keeping their memory for the next tree
+void astClear(Ast *a);
+// frees all the memory of the tree
+void astFree(Ast *a);
+// shows the subtree of the node n, indented by depth levels
+void showAst(Ast *a,NodeId n,int depth);
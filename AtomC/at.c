@@ -72,7 +72,7 @@ bool arithTypeTo(Type *t1,Type *t2,Type *dst){
 
 Symbol *findSymbolInList(Symbol *list,const char *name){
 	for(Symbol *s=list;s;s=s->next){
-			if(!strcmp(s->name,name))return s;
+			if(s->name==name)return s;
 		}
 	return NULL;
 	}
@@ -25,6 +25,6 @@ bool convTo(Type *src,Type *dst);
 // ex: double + int -> double
 bool arithTypeTo(Type *t1,Type *t2,Type *dst);
 
-// searches a name in a list of symbols
+// searches an interned name in a list of symbols
 // if it finds it, returns the correspondent symbol, else NULL
 Symbol *findSymbolInList(Symbol *list,const char *name);
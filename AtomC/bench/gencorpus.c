@@ -0,0 +1,260 @@
+// generator of synthetic AtomC sources for the benchmarks
+// the sources are valid AtomC (syntactically and semantically) and the same arguments always give the same source
+//
+// usage: gencorpus [options] > file.c
+//   -p profile     the mix of the generated atoms (default: mixed)
+//                    mixed     structs, functions, statements, literals and comments in usual proportions
+//                    nested    deeply nested if/while blocks
+//                    comments  long // comments between the statements
+//                    numbers   expressions with many INT and DOUBLE literals
+//                    idents    long identifiers, used in many expressions
+//   -s N           the number of structs (default: 20)
+//   -f N           the number of functions (default: 1000)
+//   -n N           the number of statements in a function body (default: 40)
+//   -d N           the maximum nesting depth of the blocks (default: 2, or 12 for nested)
+//   -kb N          generates functions until the source has at least N KB (instead of -f)
+//   -seed N        the seed of the random generator (default: 1)
+//   -o file        writes the source to file instead of to stdout
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+enum { P_MIXED, P_NESTED, P_COMMENTS, P_NUMBERS, P_IDENTS };
+static const char *profileNames[] = {"mixed", "nested", "comments", "numbers", "idents"};
+
+static int profile = P_MIXED;
+static int nStructs = 20, nFns = 1000, nStms = 40, maxDepth = -1;
+static long minKb = 0;
+static unsigned long seed = 1;
+static FILE *out;
+static long written;
+
+// a small LCG, so the sources do not depend on the C library
+static unsigned rnd(unsigned n) {
+    seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+    return (unsigned)(seed >> 33) % n;
+}
+
+static void emit(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void emit(const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    written += vfprintf(out, fmt, va);
+    va_end(va);
+}
+
+static const char *words[] = {
+    "the", "value", "is", "computed", "from", "index", "and", "stored", "in", "buffer", "before",
+    "loop", "checks", "limit", "result", "returned", "to", "caller", "when", "done", "temporary",
+};
+
+static void comment(int indent) {
+    int n = profile == P_COMMENTS ? 20 + rnd(60) : 4 + rnd(8);
+    emit("%*s//", indent, "");
+    for(int i = 0; i < n; i++) emit(" %s", words[rnd(sizeof(words) / sizeof(words[0]))]);
+    emit("\n");
+}
+
+// the locals of each function; the idents profile uses long names
+#define N_INTS 4
+static char intVars[N_INTS][48];
+static char dblVar[48], arrVar[48], stVar[48];
+
+static void setNames() {
+    const char *shortNames[N_INTS] = {"i", "j", "k", "n"};
+    for(int i = 0; i < N_INTS; i++) {
+        if(profile == P_IDENTS) sprintf(intVars[i], "current_position_of_element_%s_%d", shortNames[i], i);
+        else strcpy(intVars[i], shortNames[i]);
+    }
+    strcpy(dblVar, profile == P_IDENTS ? "accumulated_floating_point_total" : "d");
+    strcpy(arrVar, profile == P_IDENTS ? "intermediate_results_buffer" : "arr");
+    strcpy(stVar, profile == P_IDENTS ? "structured_record_instance" : "st");
+}
+
+static const char *intVar() {
+    return intVars[rnd(N_INTS)];
+}
+
+static void intLiteral() {
+    emit("%u", rnd(profile == P_NUMBERS ? 1000000 : 100));
+}
+
+static void doubleLiteral() {
+    switch(rnd(3)) {
+        case 0: emit("%u.%u", rnd(1000), rnd(100000)); break;
+        case 1: emit("%u.%ue-%u", rnd(10), rnd(1000), 1 + rnd(9)); break;
+        default: emit("%ue%u", 1 + rnd(9), rnd(20)); break;
+    }
+}
+
+// an int expression of n operands, without parentheses
+static void intExpr(int n) {
+    static const char ops[] = "+-*/";
+    for(int i = 0; i < n; i++) {
+        if(i) emit("%c", ops[rnd(4)]);
+        int kind = profile == P_NUMBERS ? rnd(3) : rnd(6);
+        switch(kind) {
+            case 0: intLiteral(); break;
+            case 1: emit("%s[%u]", arrVar, rnd(10)); break;
+            case 2: emit("%s.x", stVar); break;
+            default: emit("%s", intVar());
+        }
+    }
+}
+
+static void doubleExpr(int n) {
+    static const char ops[] = "+-*/";
+    for(int i = 0; i < n; i++) {
+        if(i) emit("%c", ops[rnd(4)]);
+        switch(rnd(profile == P_NUMBERS ? 2 : 4)) {
+            case 0: doubleLiteral(); break;
+            case 1: emit("%s", dblVar); break;
+            case 2: emit("%s.y", stVar); break;
+            default: emit("%s", intVar());
+        }
+    }
+}
+
+static void condition() {
+    static const char *rel[] = {"<", "<=", ">", ">=", "==", "!="};
+    emit("%s%s", intVar(), rel[rnd(6)]);
+    intLiteral();
+    if(rnd(2)) {
+        emit("%s%s%s", rnd(2) ? "&&" : "||", dblVar, rel[rnd(6)]);
+        doubleLiteral();
+    }
+}
+
+static void statement(int indent, int depth, int fn, int chain);
+
+// if chain, the first statement of the block is nested again, so the blocks go deep but not wide
+static void block(int indent, int depth, int fn, int n, int chain) {
+    emit("{\n");
+    for(int i = 0; i < n; i++) statement(indent + 4, depth, fn, chain && !i);
+    emit("%*s}", indent, "");
+}
+
+static void statement(int indent, int depth, int fn, int chain) {
+    if(rnd(profile == P_COMMENTS ? 2 : 8) == 0) comment(indent);
+    // the nested profile starts chains of blocks only from the function's body
+    int nested = depth < maxDepth && (chain || ((profile != P_NESTED || !depth) && rnd(6) == 0));
+    emit("%*s", indent, "");
+    if(nested) {
+        int n = 1 + rnd(3);
+        if(rnd(2)) {
+            emit("if(");
+            condition();
+            emit(")");
+            block(indent, depth + 1, fn, n, profile == P_NESTED);
+            if(rnd(2)) {
+                emit("else");
+                block(indent, depth + 1, fn, 1 + rnd(2), 0);
+            }
+        } else {
+            emit("while(");
+            condition();
+            emit(")");
+            block(indent, depth + 1, fn, n, profile == P_NESTED);
+        }
+        emit("\n");
+        return;
+    }
+    int len = profile == P_NUMBERS || profile == P_IDENTS ? 4 + rnd(6) : 2 + rnd(4);
+    switch(rnd(7)) {
+        case 0: case 1:
+            emit("%s=", intVar());
+            intExpr(len);
+            break;
+        case 2:
+            emit("%s=", dblVar);
+            doubleExpr(len);
+            break;
+        case 3:
+            emit("%s[%u]=", arrVar, rnd(10));
+            intExpr(len);
+            break;
+        case 4:
+            emit("%s.y=", stVar);
+            doubleExpr(len);
+            break;
+        case 5:
+            emit("%s=len(\"%s %s\")", intVar(), words[rnd(sizeof(words) / sizeof(words[0]))],
+                words[rnd(sizeof(words) / sizeof(words[0]))]);
+            break;
+        default:
+            // a call of a previous function
+            if(fn > 0) {
+                emit("%s=f%u(%s,", intVar(), rnd(fn), intVar());
+                doubleExpr(2);
+                emit(")");
+            } else {
+                emit("%s.x=%s", stVar, intVar());
+            }
+    }
+    emit(";\n");
+}
+
+static void structDef(int i) {
+    if(profile != P_NUMBERS) comment(0);
+    emit("struct S%d{\n    int x;\n    double y;\n    int v[%u];\n", i, 2 + rnd(30));
+    if(i > 0) emit("    struct S%u inner;\n", rnd(i));
+    emit("};\n");
+}
+
+static void fnDef(int fn) {
+    if(rnd(2)) comment(0);
+    emit("int f%d(int %s,double %s){\n", fn, intVars[3], dblVar);
+    for(int i = 0; i < N_INTS - 1; i++) emit("    int %s;\n", intVars[i]);
+    emit("    int %s[10];\n    struct S%u %s;\n", arrVar, nStructs ? rnd(nStructs) : 0, stVar);
+    for(int i = 0; i < N_INTS - 1; i++) emit("    %s=%u;\n", intVars[i], rnd(10));
+    for(int i = 0; i < nStms; i++) statement(4, 0, fn, 0);
+    emit("    return %s;\n}\n", intVar());
+}
+
+int main(int argc, char **argv) {
+    const char *outName = NULL;
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i], *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if(!val) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 1;
+        }
+        i++;
+        if(!strcmp(arg, "-p")) {
+            int p;
+            for(p = 0; p < 5 && strcmp(val, profileNames[p]); p++) {}
+            if(p == 5) {
+                fprintf(stderr, "unknown profile: %s\n", val);
+                return 1;
+            }
+            profile = p;
+        } else if(!strcmp(arg, "-s")) nStructs = atoi(val);
+        else if(!strcmp(arg, "-f")) nFns = atoi(val);
+        else if(!strcmp(arg, "-n")) nStms = atoi(val);
+        else if(!strcmp(arg, "-d")) maxDepth = atoi(val);
+        else if(!strcmp(arg, "-kb")) minKb = atol(val);
+        else if(!strcmp(arg, "-seed")) seed = strtoul(val, NULL, 10);
+        else if(!strcmp(arg, "-o")) outName = val;
+        else {
+            fprintf(stderr, "unknown option: %s\n", arg);
+            return 1;
+        }
+    }
+    if(maxDepth < 0) maxDepth = profile == P_NESTED ? 12 : 2;
+    if(nStructs < 1) nStructs = 1;
+    out = outName ? fopen(outName, "w") : stdout;
+    if(!out) {
+        fprintf(stderr, "cannot write %s\n", outName);
+        return 1;
+    }
+    setNames();
+
+    emit("// generated by gencorpus -p %s\n", profileNames[profile]);
+    for(int i = 0; i < nStructs; i++) structDef(i);
+    emit("int len(char s[]){\n    int i;\n    i=0;\n    while(s[i])i=i+1;\n    return i;\n}\n");
+    for(int fn = 0; minKb ? written < minKb * 1024 : fn < nFns; fn++) fnDef(fn);
+    if(out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,130 @@
+// throughput benchmark for tokenize
+// for each source it makes a first (cold) run, which also fills the intern pool, then the timed runs
+// it reports for each source:
+//   MB/s and tokens/s from the best run (the median is also given, to see the noise)
+//   the allocations (calls of safeAlloc/safeRealloc and their bytes) of the cold run and of one warm run
+//   (they are counted only when utils.c is built with COUNT_ALLOCS, like in "make lexbench")
+//   the peak RSS of the process after the source was lexed
+// the results can be written to a JSON file, to be compared between versions
+//
+// usage: lexbench [-r runs] [-o result.json] source...
+// the sources can be generated with gencorpus (see "make bench")
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../lexer.h"
+#include "../utils.h"
+#include "../scan.h"
+
+typedef struct {
+    const char *name;
+    size_t bytes;
+    int tokens;
+    double best, median;            // seconds
+    size_t coldAllocs, coldBytes;   // the allocations of the first run
+    size_t warmAllocs, warmBytes;   // the allocations of one of the next runs
+    long peakRssKb;
+} Result;
+
+static InternPool names;    // shared by all the sources, like in a compiler which lexes several files
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static long peakRssKb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;    // KB on Linux
+}
+
+// lexes src once and returns the time; the allocations are added to *allocs and *bytes
+static double lexOnce(const char *src, int *nTokens, size_t *allocs, size_t *bytes) {
+    size_t a = nAllocs, b = nAllocBytes;
+    double t = now();
+    Token *tks = tokenize(&names, src, nTokens);
+    t = now() - t;
+    *allocs = nAllocs - a;
+    *bytes = nAllocBytes - b;
+    free(tks);
+    return t;
+}
+
+static void bench(Result *r, int runs) {
+    char *src = loadFile(r->name);
+    r->bytes = strlen(src);
+    lexOnce(src, &r->tokens, &r->coldAllocs, &r->coldBytes);
+    double *times = safeAlloc(runs * sizeof(double));
+    for(int i = 0; i < runs; i++) times[i] = lexOnce(src, &r->tokens, &r->warmAllocs, &r->warmBytes);
+    qsort(times, runs, sizeof(double), cmpDouble);
+    r->best = times[0];
+    r->median = times[runs / 2];
+    r->peakRssKb = peakRssKb();
+    free(times);
+    free(src);
+}
+
+static void writeJson(const char *fileName, const Result *results, int n, int runs) {
+    FILE *f = fopen(fileName, "w");
+    if(!f) err("cannot write %s", fileName);
+    fprintf(f, "{\n  \"benchmark\": \"tokenize\",\n  \"isa\": \"%s\",\n  \"runs\": %d,\n  \"results\": [\n", scanIsa, runs);
+    for(int i = 0; i < n; i++) {
+        const Result *r = &results[i];
+        fprintf(f, "    {\"file\": \"%s\", \"bytes\": %zu, \"tokens\": %d, \"best_ms\": %.3f, \"median_ms\": %.3f, "
+            "\"mb_per_s\": %.1f, \"tokens_per_s\": %.0f, \"cold_allocs\": %zu, \"cold_alloc_bytes\": %zu, "
+            "\"warm_allocs\": %zu, \"warm_alloc_bytes\": %zu, \"peak_rss_kb\": %ld}%s\n",
+            r->name, r->bytes, r->tokens, r->best * 1e3, r->median * 1e3, r->bytes / 1e6 / r->best,
+            r->tokens / r->best, r->coldAllocs, r->coldBytes, r->warmAllocs, r->warmBytes, r->peakRssKb,
+            i < n - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    int runs = 10;
+    const char *jsonName = NULL;
+    Result *results = safeAlloc(argc * sizeof(Result));
+    int n = 0;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            if(runs < 1) runs = 1;
+        } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+            jsonName = argv[++i];
+        } else {
+            memset(&results[n], 0, sizeof(Result));
+            results[n++].name = argv[i];
+        }
+    }
+    if(!n) {
+        printf("Usage: %s [-r runs] [-o result.json] source...\n", argv[0]);
+        return 1;
+    }
+    scanInit();
+    internInit(&names, NULL);
+    printf("kernels: %s, %d runs\n", scanIsa, runs);
+    printf("%-28s %9s %9s %8s %8s %10s %10s %10s\n", "source", "MB", "tokens", "MB/s", "Mtk/s",
+        "median ms", "allocs", "peak RSS");
+    for(int i = 0; i < n; i++) {
+        Result *r = &results[i];
+        bench(r, runs);
+        printf("%-28s %9.2f %9d %8.1f %8.2f %10.2f %4zu/%-5zu %7ld KB\n", r->name, r->bytes / 1e6, r->tokens,
+            r->bytes / 1e6 / r->best, r->tokens / 1e6 / r->best, r->median * 1e3, r->coldAllocs, r->warmAllocs,
+            r->peakRssKb);
+    }
+    if(jsonName) writeJson(jsonName, results, n, runs);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// microbenchmark for the conversion of the numeric atoms
+// compares the previous lexer path (heap copy of the atom + atoi/atof + free)
+// with parseInt/parseDouble, which work directly on the chars from source
+// it also verifies that parseDouble gives exactly the same bits as strtod
+//
+// usage: numbench [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../numlit.h"
+
+typedef struct {
+    int begin, end;   // the atom's position in buf
+    int isDouble;
+} Literal;
+
+static char *buf;
+static Literal *lits;
+static int nLits;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// adds random literals in the forms used in the generated sources: 123 3.25 0.001 1e10 2.5E-3 and a few long ones
+static void genLiterals(int count) {
+    size_t cap = (size_t)count * 32 + 1, len = 0;
+    buf = malloc(cap);
+    lits = malloc(count * sizeof(Literal));
+    srand(12345);
+    for(int i = 0; i < count; i++) {
+        Literal *l = &lits[nLits++];
+        l->begin = (int)len;
+        int n;
+        switch(rand() % 6) {
+            case 0: n = sprintf(buf + len, "%d", rand() % 100000); l->isDouble = 0; break;
+            case 1: n = sprintf(buf + len, "%d.%d", rand() % 1000, rand() % 1000); l->isDouble = 1; break;
+            case 2: n = sprintf(buf + len, "0.%06d", rand() % 1000000); l->isDouble = 1; break;
+            case 3: n = sprintf(buf + len, "%de%d", rand() % 100, rand() % 40 - 20); l->isDouble = 1; break;
+            case 4: n = sprintf(buf + len, "%d.%dE%+d", rand() % 10, rand() % 100000, rand() % 600 - 300); l->isDouble = 1; break;
+            default: n = sprintf(buf + len, "%d%09d.%09d", rand() % 1000, rand(), rand() % 1000000000); l->isDouble = 1; break;
+        }
+        len += n;
+        l->end = (int)len;
+        buf[len++] = ';';     // the atoms are followed by a char which does not continue a number
+    }
+    buf[len] = '\0';
+}
+
+static double oldPath(const Literal *l) {
+    int n = l->end - l->begin;
+    char *numStr = malloc(n + 1);
+    memcpy(numStr, buf + l->begin, n);
+    numStr[n] = '\0';
+    double v = l->isDouble ? atof(numStr) : atoi(numStr);
+    free(numStr);
+    return v;
+}
+
+static double newPath(const Literal *l) {
+    const char *b = buf + l->begin, *e = buf + l->end;
+    return l->isDouble ? parseDouble(b, e) : parseInt(b, e);
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    genLiterals(count);
+
+    int nErrors = 0;
+    for(int i = 0; i < nLits; i++) {
+        double a = strtod(buf + lits[i].begin, NULL), b = newPath(&lits[i]);
+        if(memcmp(&a, &b, sizeof(double))) {
+            if(nErrors++ < 10) printf("mismatch: %.*s\n", lits[i].end - lits[i].begin, buf + lits[i].begin);
+        }
+    }
+    printf("%d literals, %d mismatches with strtod\n", nLits, nErrors);
+
+    const int rounds = 5;
+    double best[2] = {1e30, 1e30}, sum[2] = {0, 0};
+    for(int r = 0; r < rounds; r++) {
+        for(int k = 0; k < 2; k++) {
+            double t = now();
+            for(int i = 0; i < nLits; i++) sum[k] += k ? newPath(&lits[i]) : oldPath(&lits[i]);
+            t = now() - t;
+            if(t < best[k]) best[k] = t;
+        }
+    }
+    printf("copy+atoi/atof: %.1f ns/literal\n", best[0] * 1e9 / nLits);
+    printf("parseInt/parseDouble: %.1f ns/literal (%.2fx)\n", best[1] * 1e9 / nLits, best[0] / best[1]);
+    return nErrors != 0 || sum[0] != sum[1];
+}
@@ -0,0 +1,104 @@
+// benchmark for the lexer thread pipeline
+// compares the compile time (lexing + parsing + domain analysis) of:
+//   tokenize + parse: the whole source is lexed first, then parsed
+//   on demand: parseSource, which lexes each token when the parser needs it
+//   lexer thread: parseSource with the lexer on its own thread, which sends batches of tokens to the parser
+// the source is generated in memory, with functions which have many statements
+//
+// usage: pipebench [functions] [statements]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lexer.h"
+#include "../parser.h"
+#include "../ad.h"
+#include "../vm.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *statements[] = {
+    "c=c+a*2-c/3;",
+    "if(c>=a&&b!=1.5)d=d+b*c;else d=d-1;",
+    "while(c<100){c=c+1;v[c/10]=c;}",
+    "p.x=v[2]+c;",
+    "p.y=d*0.5+p.x;",
+    "d=d*b-a/2.0;",
+};
+
+static char *genSource(int nFns, int nStms) {
+    int nForms = sizeof(statements) / sizeof(statements[0]);
+    size_t cap = 64 + (size_t)nFns * (128 + nStms * 48), len = 0;
+    char *src = malloc(cap);
+    len += sprintf(src + len, "struct P{int x;double y;};\n");
+    for(int i = 0; i < nFns; i++) {
+        len += sprintf(src + len, "int f%d(int a,double b){\nint c;double d;struct P p;int v[10];\nc=a;d=b;\n", i);
+        for(int j = 0; j < nStms; j++) {
+            len += sprintf(src + len, "%s\n", statements[(i + j) % nForms]);
+        }
+        len += sprintf(src + len, "return c+p.x;\n}\n");
+    }
+    return src;
+}
+
+// runs one mode and returns its time; the global domain of parse is dropped after each run
+static double runMode(Parser *p, const char *src, int mode) {
+    double t = now();
+    bool ok = false;
+    switch(mode) {
+        case 0: {
+            int nTokens;
+            Token *tokens = tokenize(p->names, src, &nTokens);
+            ok = parse(p, src, tokens);
+            free(tokens);
+            break;
+        }
+        case 1: ok = parseSource(p, src, false); break;
+        case 2: ok = parseSource(p, src, true); break;
+    }
+    t = now() - t;
+    if(!ok) {
+        fprintf(stderr, "%s\n", p->errMsg);
+        exit(EXIT_FAILURE);
+    }
+    dropDomain(p->st);
+    return t;
+}
+
+int main(int argc, char **argv) {
+    int nFns = argc > 1 ? atoi(argv[1]) : 2000;
+    int nStms = argc > 2 ? atoi(argv[2]) : 200;
+    const char *modeNames[] = {"tokenize + parse", "on demand", "lexer thread"};
+    char *src = genSource(nFns, nStms);
+    double mb = strlen(src) / 1e6;
+    InternPool names;
+    internInit(&names, NULL);
+    SymTable st;
+    symTableInit(&st, NULL);
+    pushDomain(&st);
+    vmInit(&st, &names);
+    Parser p;
+    parserInit(&p, &st, &names);
+    printf("source: %.1f MB, %d functions with %d statements\n", mb, nFns, nStms);
+
+    double best[3] = {1e9, 1e9, 1e9};
+    for(int rep = 0; rep < 5; rep++) {
+        for(int mode = 0; mode < 3; mode++) {
+            double t = runMode(&p, src, mode);
+            if(t < best[mode]) best[mode] = t;
+        }
+    }
+    for(int mode = 0; mode < 3; mode++) {
+        printf("%-18s %8.1f ms  %7.1f MB/s  speedup %.2f\n", modeNames[mode], best[mode] * 1e3,
+            mb / best[mode], best[0] / best[mode]);
+    }
+    parserFree(&p);
+    free(src);
+    return 0;
+}
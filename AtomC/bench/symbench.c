@@ -0,0 +1,81 @@
+// benchmark for the symbols lookup in large domains
+// the source is generated in memory: many global variables, then functions which use them
+// each global is defined once (with a redefinition check) and used several times, so the time of
+// the parse grows with the cost of the symbols lookup
+// the tokens are lexed once, before the timed runs, so only the parse and the domain analysis are timed
+//
+// usage: symbench [globals] [functions]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../lexer.h"
+#include "../parser.h"
+#include "../ad.h"
+#include "../vm.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// each function uses 8 globals, spread over all the domain
+static char *genSource(int nGlobals, int nFns) {
+    size_t cap = 64 + (size_t)nGlobals * 24 + (size_t)nFns * 256, len = 0;
+    char *src = malloc(cap);
+    for(int i = 0; i < nGlobals; i++) {
+        len += sprintf(src + len, i % 2 ? "int g%d;\n" : "double g%d;\n", i);
+    }
+    unsigned seed = 1;
+    for(int i = 0; i < nFns; i++) {
+        len += sprintf(src + len, "int f%d(int a){\n", i);
+        for(int j = 0; j < 4; j++) {
+            seed = seed * 1103515245 + 12345;
+            int x = (seed >> 8) % nGlobals;
+            seed = seed * 1103515245 + 12345;
+            int y = (seed >> 8) % nGlobals;
+            len += sprintf(src + len, "g%d=g%d+a;\n", x, y);
+        }
+        len += sprintf(src + len, "return a;\n}\n");
+    }
+    return src;
+}
+
+int main(int argc, char **argv) {
+    int nGlobals = argc > 1 ? atoi(argv[1]) : 100000;
+    int nFns = argc > 2 ? atoi(argv[2]) : 100000;
+    char *src = genSource(nGlobals, nFns);
+    InternPool names;
+    internInit(&names, NULL);
+    int nTokens;
+    Token *tokens = tokenize(&names, src, &nTokens);
+    SymTable st;
+    symTableInit(&st, NULL);
+    pushDomain(&st);
+    vmInit(&st, &names);
+    Parser p;
+    parserInit(&p, &st, &names);
+    printf("source: %.1f MB, %d globals, %d functions\n", strlen(src) / 1e6, nGlobals, nFns);
+
+    double best = 1e9;
+    for(int rep = 0; rep < 5; rep++) {
+        double t = now();
+        if(!parse(&p, src, tokens)) {
+            fprintf(stderr, "%s\n", p.errMsg);
+            return 1;
+        }
+        t = now() - t;
+        dropDomain(&st);
+        if(t < best) best = t;
+    }
+    // the lookups: a redefinition check for each global and function, 8 uses in each function
+    long nLookups = (long)nGlobals + nFns * 9L;
+    printf("parse: %.1f ms, %.1f ns/lookup (including the rest of the parse)\n", best * 1e3, best * 1e9 / nLookups);
+    parserFree(&p);
+    free(tokens);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "driver.h"
+#include "parser.h"
+#include "vm.h"
+#include "pool.h"
+#include "utils.h"
+
+typedef struct {
+    const char *fileName;
+    long size;             // the file size, used to start with the largest files
+    bool ok;
+    char msg[256];         // the error, if !ok
+} FileJob;
+
+typedef struct {
+    FileJob *jobs;
+    FileJob **order;       // the jobs, in the order they are started
+    bool useMmap;
+    const InternPool *builtinNames;
+    const SymTable *builtins;  // the table with the extern functions or the prelude, the base of the units' tables
+} Batch;
+
+static void compileFile(Batch *b, FileJob *job) {
+    InternPool names;
+    internInit(&names, b->builtinNames);
+    SymTable st;
+    symTableInit(&st, b->builtins);
+    SrcFile src = {NULL, 0, false};
+    ErrHandler h;
+    errPush(&h);
+    if (setjmp(h.env)) {
+        // the file cannot be loaded
+        job->ok = false;
+        strcpy(job->msg, h.msg);
+    } else {
+        src = b->useMmap ? mapFile(job->fileName) : (SrcFile){loadFile(job->fileName), 0, false};
+        errPop(&h);
+        Parser p;
+        parserInit(&p, &st, &names);
+        job->ok = parseSource(&p, src.data, false);
+        if (job->ok) dropDomain(&st);
+        else strcpy(job->msg, p.errMsg);
+        parserFree(&p);
+    }
+    if (src.data) unmapFile(&src);
+    symTableFree(&st);
+    internFree(&names);
+}
+
+static void compileJob(void *arg, int i) {
+    Batch *b = (Batch *)arg;
+    compileFile(b, b->order[i]);
+}
+
+// the largest files first, so at the end there are only small files left to balance the threads
+static int cmpSize(const void *a, const void *b) {
+    const FileJob *x = *(FileJob *const *)a, *y = *(FileJob *const *)b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x < y ? -1 : x > y;
+}
+
+int compileFiles(const char **fileNames, int nFiles, int nThreads, bool useMmap, const Prelude *prelude) {
+    InternPool builtinNames;
+    internInit(&builtinNames, NULL);
+    SymTable builtins;
+    symTableInit(&builtins, NULL);
+    pushDomain(&builtins);
+    if (!prelude) vmInit(&builtins, &builtinNames);
+
+    Batch b = {safeAlloc(nFiles * sizeof(FileJob)), safeAlloc(nFiles * sizeof(FileJob *)), useMmap,
+        prelude ? &prelude->names : &builtinNames, prelude ? &prelude->st : &builtins};
+    for (int i = 0; i < nFiles; i++) {
+        FileJob *job = &b.jobs[i];
+        job->fileName = fileNames[i];
+        struct stat st;
+        job->size = stat(fileNames[i], &st) ? 0 : (long)st.st_size;
+        b.order[i] = job;
+    }
+    qsort(b.order, nFiles, sizeof(FileJob *), cmpSize);
+
+    if (nThreads <= 0) nThreads = cpuCount();
+    if (nThreads > nFiles) nThreads = nFiles;
+    Pool *pool = poolNew(nThreads);
+    poolFor(pool, nFiles, compileJob, &b);
+    poolFree(pool);
+
+    int nErrors = 0;
+    for (int i = 0; i < nFiles; i++) {
+        FileJob *job = &b.jobs[i];
+        if (job->ok) {
+            printf("%s: ok\n", job->fileName);
+        } else {
+            printf("%s: %s\n", job->fileName, job->msg);
+            nErrors++;
+        }
+    }
+    printf("%d files compiled, %d with errors\n", nFiles, nErrors);
+
+    free(b.jobs);
+    free(b.order);
+    dropDomain(&builtins);
+    symTableFree(&builtins);
+    internFree(&builtinNames);
+    return nErrors;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "prelude.h"
+
+// compiles many files in parallel, each one with its own symbols table and intern pool
+// the extern functions of the VM are declared only once, in a domain and an intern pool which are shared
+// by all the compilations and are not changed while they run
+
+// compiles the files on nThreads threads (0 - one for each CPU)
+// if prelude is not NULL, its domain is used instead of the one with the extern functions
+// after all the files are compiled, it prints the result of each file, in the order of fileNames
+// returns the number of files with errors
+int compileFiles(const char **fileNames, int nFiles, int nThreads, bool useMmap, const Prelude *prelude);
@@ -0,0 +1,563 @@
+// genlex - generates the lexer tables from the tokens specification
+// usage: genlex tokens.lex lextab.h
+//
+// The rules are compiled into a Thompson NFA, the chars are grouped into classes which behave the same
+// in all the rules, and the NFA is converted into a DFA over these classes (subset construction).
+// The DFA states which loop on themselves exactly over the chars handled by a scanning kernel (see scan.h)
+// are marked, so tokenize() can jump over such runs with the kernel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#define MAX_NFA     4096
+#define MAX_DFA     255
+#define MAX_RULES   128
+#define MAX_KEYWORDS 64
+#define NFA_WORDS   (MAX_NFA / 64)
+
+typedef struct {
+    unsigned char bits[32];
+} CharSet;
+
+static void csAdd(CharSet *s, int c) { s->bits[c >> 3] |= (unsigned char)(1 << (c & 7)); }
+static bool csHas(const CharSet *s, int c) { return s->bits[c >> 3] & (1 << (c & 7)); }
+
+enum { NS_EPS, NS_SPLIT, NS_CHARS, NS_ACCEPT };
+
+typedef struct {
+    int kind;
+    CharSet set;      // for NS_CHARS
+    int out, out2;    // the next states; out2 only for NS_SPLIT
+    int rule;         // for NS_ACCEPT
+} NState;
+
+typedef struct {
+    int start, end;   // end is always a NS_EPS state with its out not set yet
+} Frag;
+
+enum { RK_TOKEN, RK_SKIP, RK_ERROR };
+
+typedef struct {
+    int kind;
+    char code[32];    // for RK_TOKEN
+    char msg[128];    // for RK_ERROR
+    bool lines;       // true if the matched text can contain '\n'
+    int start;        // the NFA start state
+} Rule;
+
+typedef struct {
+    char code[32];
+    char word[32];
+} Keyword;
+
+static NState nfa[MAX_NFA];
+static int nNfa;
+static Rule rules[MAX_RULES];
+static int nRules;
+static Keyword keywords[MAX_KEYWORDS];
+static int nKeywords;
+
+static const char *specName;
+static int specLine;
+
+static void fail(const char *fmt, ...) {
+    fprintf(stderr, "%s:%d: ", specName, specLine);
+    va_list va;
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+static int newState(int kind) {
+    if(nNfa == MAX_NFA) fail("too many NFA states");
+    NState *s = &nfa[nNfa];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->out = s->out2 = -1;
+    return nNfa++;
+}
+
+static Frag fragEmpty() {
+    int s = newState(NS_EPS);
+    return (Frag){s, s};
+}
+
+static Frag fragChars(const CharSet *set) {
+    int s = newState(NS_CHARS);
+    nfa[s].set = *set;
+    int e = newState(NS_EPS);
+    nfa[s].out = e;
+    return (Frag){s, e};
+}
+
+static Frag fragConcat(Frag a, Frag b) {
+    nfa[a.end].out = b.start;
+    return (Frag){a.start, b.end};
+}
+
+// the regex parser
+
+static const char *re;    // the current position in regex
+
+static void skipSpaces() {
+    while(*re == ' ' || *re == '\t') re++;
+}
+
+// reads a char from a literal or a class, with the escapes \n \t \r \0 and \<char>
+static int readChar() {
+    if(*re == '\0') fail("unexpected end of regex");
+    if(*re != '\\') return (unsigned char)*re++;
+    re++;
+    switch(*re++) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '0': return '\0';
+        case '\0': fail("unexpected end of regex");
+        default: return (unsigned char)re[-1];
+    }
+}
+
+static Frag parseAlt();
+
+static Frag parseAtom() {
+    CharSet set;
+    memset(&set, 0, sizeof(set));
+    if(*re == '"') {
+        re++;
+        Frag f = fragEmpty();
+        while(*re != '"') {
+            memset(&set, 0, sizeof(set));
+            csAdd(&set, readChar());
+            f = fragConcat(f, fragChars(&set));
+        }
+        re++;
+        return f;
+    }
+    if(*re == '[') {
+        re++;
+        bool negated = *re == '^';
+        if(negated) re++;
+        while(*re != ']') {
+            int first = readChar();
+            int last = first;
+            if(*re == '-' && re[1] != ']') {
+                re++;
+                last = readChar();
+            }
+            for(int c = first; c <= last; c++) csAdd(&set, c);
+        }
+        re++;
+        if(negated) {
+            for(int i = 0; i < 32; i++) set.bits[i] = (unsigned char)~set.bits[i];
+        }
+        return fragChars(&set);
+    }
+    if(*re == '(') {
+        re++;
+        Frag f = parseAlt();
+        skipSpaces();
+        if(*re != ')') fail("missing )");
+        re++;
+        return f;
+    }
+    fail("invalid regex at: %s", re);
+    return fragEmpty();
+}
+
+static Frag parsePostfix() {
+    Frag f = parseAtom();
+    for(;;) {
+        if(*re == '*') {
+            int s = newState(NS_SPLIT), e = newState(NS_EPS);
+            nfa[s].out = f.start;
+            nfa[s].out2 = e;
+            nfa[f.end].out = s;
+            f = (Frag){s, e};
+        } else if(*re == '+') {
+            int s = newState(NS_SPLIT), e = newState(NS_EPS);
+            nfa[s].out = f.start;
+            nfa[s].out2 = e;
+            nfa[f.end].out = s;
+            f = (Frag){f.start, e};
+        } else if(*re == '?') {
+            int s = newState(NS_SPLIT), e = newState(NS_EPS);
+            nfa[s].out = f.start;
+            nfa[s].out2 = e;
+            nfa[f.end].out = e;
+            f = (Frag){s, e};
+        } else {
+            return f;
+        }
+        re++;
+    }
+}
+
+static Frag parseSeq() {
+    Frag f = fragEmpty();
+    for(;;) {
+        skipSpaces();
+        if(*re == '\0' || *re == '\n' || *re == '|' || *re == ')' || *re == '#') return f;
+        f = fragConcat(f, parsePostfix());
+    }
+}
+
+static Frag parseAlt() {
+    Frag f = parseSeq();
+    while(*re == '|') {
+        re++;
+        Frag g = parseSeq();
+        int s = newState(NS_SPLIT), e = newState(NS_EPS);
+        nfa[s].out = f.start;
+        nfa[s].out2 = g.start;
+        nfa[f.end].out = e;
+        nfa[g.end].out = e;
+        f = (Frag){s, e};
+    }
+    return f;
+}
+
+// returns true if the rule can match a '\n'
+static bool ruleHasNewline(int start) {
+    static bool seen[MAX_NFA];
+    int stack[MAX_NFA], n = 0;
+    memset(seen, 0, sizeof(seen));
+    stack[n++] = start;
+    seen[start] = true;
+    while(n) {
+        NState *s = &nfa[stack[--n]];
+        if(s->kind == NS_CHARS && csHas(&s->set, '\n')) return true;
+        int outs[2] = {s->out, s->kind == NS_SPLIT ? s->out2 : -1};
+        for(int i = 0; i < 2; i++) {
+            if(outs[i] >= 0 && !seen[outs[i]]) {
+                seen[outs[i]] = true;
+                stack[n++] = outs[i];
+            }
+        }
+    }
+    return false;
+}
+
+// reads a word from the spec line
+static void readWord(char *dst, size_t size) {
+    skipSpaces();
+    size_t n = 0;
+    while(*re && *re != ' ' && *re != '\t' && *re != '\n') {
+        if(n + 1 == size) fail("word too long");
+        dst[n++] = *re++;
+    }
+    dst[n] = '\0';
+    if(!n) fail("missing word");
+}
+
+static void parseSpec(const char *fileName) {
+    specName = fileName;
+    FILE *fis = fopen(fileName, "r");
+    if(!fis) fail("cannot open the file");
+    char buf[1024];
+    while(fgets(buf, sizeof(buf), fis)) {
+        specLine++;
+        re = buf;
+        skipSpaces();
+        if(*re == '#' || *re == '\n' || *re == '\0') continue;
+        char head[32];
+        readWord(head, sizeof(head));
+        if(!strcmp(head, "keyword")) {
+            if(nKeywords == MAX_KEYWORDS) fail("too many keywords");
+            Keyword *k = &keywords[nKeywords++];
+            readWord(k->code, sizeof(k->code));
+            readWord(k->word, sizeof(k->word));
+            continue;
+        }
+        if(nRules == MAX_RULES) fail("too many rules");
+        Rule *r = &rules[nRules];
+        if(!strcmp(head, "skip")) {
+            r->kind = RK_SKIP;
+        } else if(!strcmp(head, "error")) {
+            r->kind = RK_ERROR;
+            skipSpaces();
+            if(*re != '"') fail("missing error message");
+            const char *end = strchr(re + 1, '"');
+            if(!end || end - re - 1 >= (int)sizeof(r->msg)) fail("invalid error message");
+            memcpy(r->msg, re + 1, end - re - 1);
+            re = end + 1;
+        } else {
+            r->kind = RK_TOKEN;
+            strcpy(r->code, head);
+        }
+        Frag f = parseAlt();
+        skipSpaces();
+        if(*re != '\0' && *re != '\n' && *re != '#') fail("invalid regex at: %s", re);
+        int acc = newState(NS_ACCEPT);
+        nfa[acc].rule = nRules;
+        nfa[f.end].out = acc;
+        r->start = f.start;
+        r->lines = ruleHasNewline(f.start);
+        nRules++;
+    }
+    fclose(fis);
+    if(!nRules) fail("no rules");
+}
+
+// char classes
+
+enum { K_NONE, K_IDENT, K_LINE_END, K_QUOTE, K_BLANKS, K_COUNT };
+static const char *kernelNames[K_COUNT] = {"LXK_NONE", "LXK_IDENT", "LXK_LINE_END", "LXK_QUOTE", "LXK_BLANKS"};
+static CharSet kernelSets[K_COUNT];     // the chars on which each kernel advances
+
+static void initKernelSets() {
+    for(int c = 0; c < 256; c++) {
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') csAdd(&kernelSets[K_IDENT], c);
+        if(c != '\n' && c != '\0') csAdd(&kernelSets[K_LINE_END], c);
+        if(c != '"' && c != '\0') csAdd(&kernelSets[K_QUOTE], c);
+        if(c == ' ' || c == '\t' || c == '\r' || c == '\n') csAdd(&kernelSets[K_BLANKS], c);
+    }
+}
+
+static int charClass[256];
+static int classRep[256];     // a char from each class
+static int nClasses;
+
+// two chars are in the same class if they are in the same NFA char sets and kernel sets
+static bool sameBehaviour(int a, int b) {
+    for(int i = 0; i < nNfa; i++) {
+        if(nfa[i].kind == NS_CHARS && csHas(&nfa[i].set, a) != csHas(&nfa[i].set, b)) return false;
+    }
+    for(int k = 1; k < K_COUNT; k++) {
+        if(csHas(&kernelSets[k], a) != csHas(&kernelSets[k], b)) return false;
+    }
+    return true;
+}
+
+static void computeClasses() {
+    for(int c = 0; c < 256; c++) {
+        int k;
+        for(k = 0; k < nClasses; k++) {
+            if(sameBehaviour(c, classRep[k])) break;
+        }
+        if(k == nClasses) classRep[nClasses++] = c;
+        charClass[c] = k;
+    }
+}
+
+// subset construction
+
+typedef struct {
+    unsigned long long bits[NFA_WORDS];
+} NfaSet;
+
+static NfaSet dfaSets[MAX_DFA + 1];
+static int dfaNext[MAX_DFA + 1][256];
+static int dfaAccept[MAX_DFA + 1];
+static int dfaKernel[MAX_DFA + 1];
+static int nDfa;    // state 0 is the dead state
+
+static void addClosure(NfaSet *set, int s) {
+    if(s < 0 || (set->bits[s / 64] >> (s % 64)) & 1) return;
+    set->bits[s / 64] |= 1ULL << (s % 64);
+    if(nfa[s].kind == NS_EPS) addClosure(set, nfa[s].out);
+    else if(nfa[s].kind == NS_SPLIT) {
+        addClosure(set, nfa[s].out);
+        addClosure(set, nfa[s].out2);
+    }
+}
+
+static bool isEmpty(const NfaSet *set) {
+    for(int i = 0; i < NFA_WORDS; i++) {
+        if(set->bits[i]) return false;
+    }
+    return true;
+}
+
+// returns the DFA state for the given set, adding it if it is new
+static int dfaState(const NfaSet *set) {
+    if(isEmpty(set)) return 0;
+    for(int i = 1; i < nDfa; i++) {
+        if(!memcmp(&dfaSets[i], set, sizeof(NfaSet))) return i;
+    }
+    if(nDfa > MAX_DFA) fail("too many DFA states");
+    dfaSets[nDfa] = *set;
+    int accept = -1;
+    for(int s = 0; s < nNfa; s++) {
+        if(((set->bits[s / 64] >> (s % 64)) & 1) && nfa[s].kind == NS_ACCEPT) {
+            if(accept < 0 || nfa[s].rule < accept) accept = nfa[s].rule;
+        }
+    }
+    dfaAccept[nDfa] = accept;
+    return nDfa++;
+}
+
+static void buildDfa() {
+    NfaSet start;
+    memset(&start, 0, sizeof(start));
+    for(int r = 0; r < nRules; r++) addClosure(&start, rules[r].start);
+    nDfa = 1;
+    dfaAccept[0] = -1;
+    dfaState(&start);
+    for(int d = 1; d < nDfa; d++) {
+        for(int k = 0; k < nClasses; k++) {
+            NfaSet next;
+            memset(&next, 0, sizeof(next));
+            for(int s = 0; s < nNfa; s++) {
+                if(((dfaSets[d].bits[s / 64] >> (s % 64)) & 1) && nfa[s].kind == NS_CHARS && csHas(&nfa[s].set, classRep[k])) {
+                    addClosure(&next, nfa[s].out);
+                }
+            }
+            dfaNext[d][k] = dfaState(&next);
+        }
+    }
+    // a state gets a kernel if it loops on itself exactly on the kernel's chars
+    for(int d = 1; d < nDfa; d++) {
+        for(int kn = 1; kn < K_COUNT; kn++) {
+            bool match = true;
+            for(int c = 0; c < 256 && match; c++) {
+                match = (dfaNext[d][charClass[c]] == d) == csHas(&kernelSets[kn], c);
+            }
+            if(match) dfaKernel[d] = kn;
+        }
+    }
+}
+
+// the number of chars which the lexer can consume after the end of a match, through states which do not accept,
+// before it stops; after them it reads one more char, which has no transition
+// it is -1 if it is not bounded (a loop through states which do not accept)
+static int dfaOverrun;
+
+// the longest path through states which do not accept, starting with d; -1 for a loop
+static int pathFrom(int d, int *memo, bool *visiting) {
+    if(memo[d]) return memo[d];
+    if(visiting[d]) return -1;
+    visiting[d] = true;
+    int longest = 1;
+    for(int k = 0; k < nClasses; k++) {
+        int next = dfaNext[d][k];
+        if(!next || dfaAccept[next] >= 0) continue;
+        int n = pathFrom(next, memo, visiting);
+        if(n < 0) return -1;
+        if(n + 1 > longest) longest = n + 1;
+    }
+    visiting[d] = false;
+    return memo[d] = longest;
+}
+
+static void computeOverrun() {
+    int memo[MAX_DFA + 1] = {0};
+    bool visiting[MAX_DFA + 1] = {false};
+    dfaOverrun = 0;
+    for(int d = 1; d < nDfa; d++) {
+        if(dfaAccept[d] < 0) continue;
+        for(int k = 0; k < nClasses; k++) {
+            int next = dfaNext[d][k];
+            if(!next || dfaAccept[next] >= 0) continue;
+            int n = pathFrom(next, memo, visiting);
+            if(n < 0) {
+                dfaOverrun = -1;
+                return;
+            }
+            if(n > dfaOverrun) dfaOverrun = n;
+        }
+    }
+}
+
+// output
+
+static int cmpKeywords(const void *a, const void *b) {
+    const Keyword *ka = a, *kb = b;
+    int la = (int)strlen(ka->word), lb = (int)strlen(kb->word);
+    if(la != lb) return la - lb;
+    return strcmp(ka->word, kb->word);
+}
+
+// keywordCode selects the keyword by its length and first char, so at most one memcmp is done in most cases
+static void writeKeywords(FILE *out) {
+    qsort(keywords, nKeywords, sizeof(Keyword), cmpKeywords);
+    fprintf(out, "// returns the code of the keyword from [begin,begin+len) or ID if it is not a keyword\n");
+    fprintf(out, "int keywordCode(const char *begin, int len) {\n    switch(len) {\n");
+    for(int i = 0; i < nKeywords;) {
+        int len = (int)strlen(keywords[i].word);
+        fprintf(out, "        case %d:\n            switch(begin[0]) {\n", len);
+        for(; i < nKeywords && (int)strlen(keywords[i].word) == len; i++) {
+            const Keyword *k = &keywords[i];
+            if(i == 0 || (int)strlen(keywords[i - 1].word) != len || keywords[i - 1].word[0] != k->word[0]) {
+                fprintf(out, "                case '%c':\n", k->word[0]);
+            }
+            fprintf(out, "                    if(!memcmp(begin, \"%s\", %d)) return %s;\n", k->word, len, k->code);
+            if(i + 1 == nKeywords || (int)strlen(keywords[i + 1].word) != len || keywords[i + 1].word[0] != k->word[0]) {
+                fprintf(out, "                    break;\n");
+            }
+        }
+        fprintf(out, "            }\n            break;\n");
+    }
+    fprintf(out, "    }\n    return ID;\n}\n");
+}
+
+static void writeTables(const char *fileName) {
+    FILE *out = fopen(fileName, "w");
+    if(!out) {
+        fprintf(stderr, "cannot create %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out, "// generated by genlex from %s - do not edit\n\n", specName);
+    fprintf(out, "#define LX_NCLASSES %d\n#define LX_NSTATES %d\n#define LX_START 1\n\n", nClasses, nDfa);
+    fprintf(out, "// the lexer reads at most the chars [end,end+LX_MAX_OVERRUN] after a match which ends at end\n"
+        "// -1 if there is no limit\n#define LX_MAX_OVERRUN %d\n\n", dfaOverrun);
+    fprintf(out, "enum { LX_TOKEN, LX_SKIP, LX_ERROR };\n\n");
+    fprintf(out, "enum {");
+    for(int k = 0; k < K_COUNT; k++) fprintf(out, "%s %s", k ? "," : "", kernelNames[k]);
+    fprintf(out, " };\n\n");
+    fprintf(out, "typedef struct {\n    int code;           // the token code for LX_TOKEN\n    int kind;           // LX_*\n"
+                 "    int lines;          // !=0 if the matched text can contain \\n\n    const char *msg;    // the message for LX_ERROR\n} LexRule;\n\n");
+
+    fprintf(out, "static const LexRule lxRules[] = {\n");
+    for(int r = 0; r < nRules; r++) {
+        const Rule *rl = &rules[r];
+        static const char *kinds[] = {"LX_TOKEN", "LX_SKIP", "LX_ERROR"};
+        fprintf(out, "    {%s, %s, %d, ", rl->kind == RK_TOKEN ? rl->code : "0", kinds[rl->kind], rl->lines);
+        if(rl->kind == RK_ERROR) fprintf(out, "\"%s\"},\n", rl->msg);
+        else fprintf(out, "NULL},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "// the class of each char\nstatic const unsigned char lxClass[256] = {");
+    for(int c = 0; c < 256; c++) fprintf(out, "%s%d,", c % 32 ? "" : "\n    ", charClass[c]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "// the next state for each state and char class; 0 is the dead state\n");
+    fprintf(out, "static const unsigned char lxNext[LX_NSTATES][LX_NCLASSES] = {\n");
+    for(int d = 0; d < nDfa; d++) {
+        fprintf(out, "    {");
+        for(int k = 0; k < nClasses; k++) fprintf(out, "%s%d", k ? "," : "", dfaNext[d][k]);
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "// the rule accepted in each state, or -1\nstatic const signed char lxAccept[LX_NSTATES] = {");
+    for(int d = 0; d < nDfa; d++) fprintf(out, "%s%d,", d % 32 ? "" : "\n    ", dfaAccept[d]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "// the kernel which can skip the chars on which a state loops on itself\nstatic const unsigned char lxKernel[LX_NSTATES] = {");
+    for(int d = 0; d < nDfa; d++) fprintf(out, "%s%d,", d % 32 ? "" : "\n    ", dfaKernel[d]);
+    fprintf(out, "\n};\n\n");
+
+    writeKeywords(out);
+    fclose(out);
+}
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s <spec> <output>\n", argv[0]);
+        return 1;
+    }
+    parseSpec(argv[1]);
+    initKernelSets();
+    computeClasses();
+    buildDfa();
+    computeOverrun();
+    writeTables(argv[2]);
+    return 0;
+}
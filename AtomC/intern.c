@@ -0,0 +1,123 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "intern.h"
+
+// an entry is stored in the arena as a header followed by the name's chars
+typedef struct{
+	unsigned hash;
+	int len;
+	}InternHdr;
+
+// FNV-1a
+static unsigned hashChars(const char *begin,const char *end){
+	unsigned h=2166136261u;
+	for(;begin!=end;begin++){
+		h^=(unsigned char)*begin;
+		h*=16777619u;
+		}
+	return h;
+	}
+
+static InternHdr *hdrOf(const char *name){
+	return (InternHdr*)name-1;
+	}
+
+// doubles the table and reinserts all the names
+static void growTable(InternPool *pool){
+	unsigned tableCap=pool->tableCap;
+	const char **table=pool->table;
+	unsigned newCap=tableCap?tableCap*2:1024;
+	const char **newTable=(const char**)safeAlloc(newCap*sizeof(const char*));
+	memset(newTable,0,newCap*sizeof(const char*));
+	for(unsigned i=0;i<tableCap;i++){
+		const char *name=table[i];
+		if(!name)continue;
+		unsigned pos=hdrOf(name)->hash&(newCap-1);
+		while(newTable[pos])pos=(pos+1)&(newCap-1);
+		newTable[pos]=name;
+		}
+	free(table);
+	pool->table=newTable;
+	pool->tableCap=newCap;
+	}
+
+// returns the slot of the name or, if the name is not in the table, the free slot where it can be added
+static unsigned findSlot(const InternPool *pool,const char *begin,int len,unsigned h){
+	unsigned mask=pool->tableCap-1;
+	unsigned pos=h&mask;
+	for(const char *name;(name=pool->table[pos])!=NULL;pos=(pos+1)&mask){
+		InternHdr *hdr=hdrOf(name);
+		if(hdr->hash==h&&hdr->len==len&&!memcmp(name,begin,len))break;
+		}
+	return pos;
+	}
+
+void internInit(InternPool *pool,const InternPool *base){
+	memset(pool,0,sizeof(InternPool));
+	pool->base=base;
+	}
+
+const char *intern(InternPool *pool,const char *begin,const char *end){
+	int len=(int)(end-begin);
+	unsigned h=hashChars(begin,end);
+	for(const InternPool *base=pool->base;base;base=base->base){
+		if(!base->tableCap)continue;
+		const char *name=base->table[findSlot(base,begin,len,h)];
+		if(name)return name;
+		}
+	if(2*(pool->nNames+1)>pool->tableCap)growTable(pool);
+	unsigned pos=findSlot(pool,begin,len,h);
+	if(pool->table[pos])return pool->table[pos];
+	InternHdr *hdr=(InternHdr*)arenaAlloc(&pool->arena,sizeof(InternHdr)+len+1);
+	hdr->hash=h;
+	hdr->len=len;
+	char *name=(char*)(hdr+1);
+	memcpy(name,begin,len);
+	name[len]='\0';
+	pool->table[pos]=name;
+	pool->nNames++;
+	return name;
+	}
+
+const char *internStr(InternPool *pool,const char *s){
+	return intern(pool,s,s+strlen(s));
+	}
+
+unsigned internHash(const char *name){
+	return hdrOf(name)->hash;
+	}
+
+const void *internEntry(const char *name,size_t *size){
+	InternHdr *hdr=hdrOf(name);
+	*size=sizeof(InternHdr)+hdr->len+1;
+	return hdr;
+	}
+
+const char *internAdopt(InternPool *pool,void *entry,size_t maxSize){
+	InternHdr *hdr=(InternHdr*)entry;
+	if((uintptr_t)entry%_Alignof(InternHdr)||maxSize<sizeof(InternHdr)||hdr->len<0||
+			(size_t)hdr->len+1>maxSize-sizeof(InternHdr))return NULL;
+	const char *name=(const char*)(hdr+1);
+	if(name[hdr->len]||memchr(name,'\0',hdr->len)||hashChars(name,name+hdr->len)!=hdr->hash)return NULL;
+	for(const InternPool *base=pool->base;base;base=base->base){
+		if(!base->tableCap)continue;
+		const char *old=base->table[findSlot(base,name,hdr->len,hdr->hash)];
+		if(old)return old;
+		}
+	if(2*(pool->nNames+1)>pool->tableCap)growTable(pool);
+	unsigned pos=findSlot(pool,name,hdr->len,hdr->hash);
+	if(!pool->table[pos]){
+		pool->table[pos]=name;
+		pool->nNames++;
+		}
+	return pool->table[pos];
+	}
+
+void internFree(InternPool *pool){
+	arenaFree(&pool->arena);
+	free(pool->table);
+	internInit(pool,pool->base);
+	}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "utils.h"
+
+// the identifiers interning pools
+// each distinct name is stored only once, so two interned names are equal if and only if their pointers are equal
+// a pool can be layered over a base pool: the names which are in base are returned from base, and only the other
+// names are added to the pool, so the names of a pool can be compared with the ones of its base
+// a base must not change while other pools use it, so it can be shared by the pools of many threads
+
+typedef struct InternPool InternPool;
+struct InternPool{
+	const InternPool *base;		// NULL for no base
+	Arena arena;		// the memory for the entries
+	const char **table;		// open addressing hash table with the interned names
+	unsigned tableCap;		// the number of slots in table (a power of 2)
+	unsigned nNames;		// the number of interned names
+	};
+
+// initializes an empty pool over base
+void internInit(InternPool *pool,const InternPool *base);
+
+// returns the unique copy of the chars from [begin,end), adding it to the pool if it is not already there
+const char *intern(InternPool *pool,const char *begin,const char *end);
+
+// interns a '\0' terminated string
+const char *internStr(InternPool *pool,const char *s);
+
+// returns the hash of an interned name, computed only once when the name was added to the pool
+unsigned internHash(const char *name);
+
+// the entry of an interned name is its header (with the hash) followed by its chars
+// an entry can be copied somewhere else (ex: in a file), aligned to 4 bytes, and added later to a pool with internAdopt
+// returns the start of the entry of name and sets in *size its size
+const void *internEntry(const char *name,size_t *size);
+// adds to pool the name from a copied entry, without copying it again, so the entry must remain in memory
+// while the pool is used; returns the interned name, which is the one from the entry if the name is new
+// the entry is checked first, because it can come from a corrupted file: it must be in the maxSize bytes
+// from its start and its name must match its header; else it returns NULL
+const char *internAdopt(InternPool *pool,void *entry,size_t maxSize);
+
+// frees the names of the pool (but not the ones of its base)
+void internFree(InternPool *pool);
@@ -1,243 +1,618 @@
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "lexer.h"
 #include "utils.h"
+#include "intern.h"
+#include "scan.h"
+#include "numlit.h"
+#include "pool.h"
 
-Token *tokens;    // single linked list of tokens
-Token *lastTk;    // the last token in list
+#define MAX_BOUNDS 64
 
-int line = 1;     // the current line in the input file
+// the state of a tokenization
+// tokenize uses only one, while tokenizeParallel uses one for each chunk of the source
+typedef struct {
+    const char *src;        // the source, for the spans of the tokens
+    InternPool *names;      // the pool where the IDs are interned
+    Token *tokens;
+    int nTokens;
+    int capTokens;
+    int line;               // the current line (relative to the chunk's start for tokenizeParallel)
+    const char *stop;       // if not NULL, the lexing stops at the first match which starts at or after it
+    const char *end;        // where the lexing stopped (at END or at stop)
+    bool deferIntern;       // IDs keep their span and are interned later by a single thread
+    // the first match boundaries (positions where a match starts) and the number of tokens before each of them
+    const char *bounds[MAX_BOUNDS];
+    int boundTks[MAX_BOUNDS];
+    int nBounds;
+    int maxBounds;          // 0 if the boundaries are not needed
+    const char *errPos;     // the position of the error, or NULL
+    char errMsg[256];
+} Lexer;
 
-Token *addTk(int code) {
-    Token *tk = safeAlloc(sizeof(Token));
-    tk->code = code;
-    tk->line = line;
-    tk->next = NULL;
-    if(lastTk) {
-        lastTk->next = tk;
-    } else {
-        tokens = tk;
+// the returned pointer is valid only until the next addTk, because the array can be reallocated
+Token *addTk(Lexer *lx, int code) {
+    if(lx->nTokens == lx->capTokens) {
+        lx->capTokens = lx->capTokens ? lx->capTokens * 2 : 1024;
+        lx->tokens = safeRealloc(lx->tokens, lx->capTokens * sizeof(Token));
     }
-    lastTk = tk;
+    Token *tk = &lx->tokens[lx->nTokens++];
+    tk->code = code;
+    tk->line = lx->line;
     return tk;
 }
 
-char *extract(const char *begin, const char *end) {
-    int length = end - begin;
-    char *str = safeAlloc(length + 1);
-    memcpy(str, begin, length);
-    str[length] = '\0';
-    return str;
+// records an error and returns false
+static bool lexFail(Lexer *lx, const char *pos, const char *fmt, ...) {
+    lx->errPos = pos;
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(lx->errMsg, sizeof(lx->errMsg), fmt, va);
+    va_end(va);
+    return false;
 }
 
-Token *tokenize(const char *pch) {
-    const char *start;
-    for(;;) {
-        switch(*pch) {
-            case ' ': case '\t': pch++; break;
-            case '\r':
-                if(pch[1] == '\n') pch++;
-                
-            case '\n':
-                line++;
-                pch++;
-                break;
-            case '\0':
-                addTk(END);
-                return tokens;
-            case ',':
-                addTk(COMMA);
-                pch++;
-                break;
-            case ';':
-                addTk(SEMICOLON);
-                pch++;
-                break;
-            case '(':
-                addTk(LPAR);
-                pch++;
-                break;
-            case ')':
-                addTk(RPAR);
-                pch++;
-                break;
-            case '{':
-                addTk(LACC);
-                pch++;
-                break;
-            case '}':
-                addTk(RACC);
-                pch++;
-                break;
-            case '[':
-                addTk(LBRACKET);
-                pch++;
-                break;
-            case ']':
-                addTk(RBRACKET);
-                pch++;
-                break;
-            case '+':
-                addTk(ADD);
-                pch++;
-                break;
-            case '-':
-                addTk(SUB);
-                pch++;
-                break;
-            case '*':
-                addTk(MUL);
-                pch++;
-                break;
-            case '.':
-                addTk(DOT);
-                pch++;
-                break;
-            case '&':
-                if(pch[1] == '&') {
-                    addTk(AND);
-                    pch += 2;
-                } else {
-                    err("Invalid &");
-                }
-                break;
-            case '|':
-                if(pch[1] == '|') {
-                    addTk(OR);
-                    pch += 2;
-                } else {
-                    err("Invalid |");
-                }
-                break;
-            case '=':
-                if(pch[1] == '=') {
-                    addTk(EQUAL);
-                    pch += 2;
-                } else {
-                    addTk(ASSIGN);
-                    pch++;
-                }
-                break;
-            case '!':
-                if(pch[1] == '=') {
-                    addTk(NOTEQ);
-                    pch += 2;
-                } else {
-                    err("Invalid !");
-                }
-                break;
-            case '<':
-                if(pch[1] == '=') {
-                    addTk(LESSEQ);
-                    pch += 2;
-                } else {
-                    addTk(LESS);
-                    pch++;
-                }
-                break;
-            case '>':
-                if(pch[1] == '=') {
-                    addTk(GREATEREQ);
-                    pch += 2;
-                } else {
-                    addTk(GREATER);
-                    pch++;
-                }
-                break;
-            case '/':
-                if(pch[1] == '/') {
-                    while(*pch != '\n' && *pch != '\0') pch++;
+const char *tkString(Arena *a, const char *src, const Token *tk) {
+    const char *begin = src + tk->span.off;
+    return arenaStrdup(a, begin, begin + tk->span.len);
+}
+
+#include "lextab.h"
+
+// advances p over the chars on which the current DFA state loops
+static const char *runKernel(int kernel, const char *p) {
+    switch(kernel) {
+        case LXK_IDENT: return skipIdent(p);
+        case LXK_LINE_END: return findLineEnd(p);
+        case LXK_QUOTE: return findQuote(p);
+        case LXK_BLANKS: return skipBlanks(p);
+    }
+    return p;
+}
+
+// adds the token matched in [start,end) by a LX_TOKEN rule
+static bool addMatch(Lexer *lx, int code, const char *start, const char *end) {
+    switch(code) {
+        case ID: {
+            int kw = keywordCode(start, (int)(end - start));
+            if(kw == ID) {
+                Token *tk = addTk(lx, ID);
+                if(lx->deferIntern) {
+                    tk->span.off = (int)(start - lx->src);
+                    tk->span.len = (int)(end - start);
                 } else {
-                    addTk(DIV);
-                    pch++;
+                    // only the real identifiers are added to the pool
+                    tk->text = intern(lx->names, start, end);
                 }
-                break;
-            case '\"': { // String literal 
-                start = ++pch;
-                while(*pch != '\"' && *pch != '\0') pch++;
-                if(*pch == '\0') err("Unclosed string");
-                char *str = extract(start, pch);
-                Token *tk = addTk(STRING);
-                tk->text = str;
-                pch++;
+            } else {
+                addTk(lx, kw);
+            }
+            break;
+        }
+        case STRING: {
+            Token *tk = addTk(lx, STRING);
+            tk->span.off = (int)(start + 1 - lx->src);
+            tk->span.len = (int)(end - start - 2);
+            break;
+        }
+        case CHAR:
+            addTk(lx, CHAR)->c = start[1];
+            break;
+        case INT: case DOUBLE: {
+            // a number cannot be followed directly by letters or by another .
+            if(isIdChar(*end) || *end == '.') {
+                while(isIdChar(*end) || *end == '.') end++;
+                return lexFail(lx, start, "Invalid number format: %.*s", (int)(end - start), start);
+            }
+            Token *tk = addTk(lx, code);
+            if(code == DOUBLE) tk->d = parseDouble(start, end);
+            else tk->i = parseInt(start, end);
+            break;
+        }
+        default:
+            addTk(lx, code);
+    }
+    return true;
+}
+
+// the tokens are recognised by the DFA generated from tokens.lex (see genlex.c)
+// the longest match wins, so the DFA runs until it has no transition and the last accepting state gives the rule
+// lexes one match from *ppch (a token or a skipped text) and advances *ppch after it
+// sets lx->end at END or at lx->stop; returns false on error
+static inline bool lexStep(Lexer *lx, const char **ppch) {
+    const char *start = *ppch, *p = start, *end = NULL;
+    if(lx->stop && start >= lx->stop) {
+        lx->end = start;
+        return true;
+    }
+    if(lx->nBounds < lx->maxBounds) {
+        lx->bounds[lx->nBounds] = start;
+        lx->boundTks[lx->nBounds++] = lx->nTokens;
+    }
+    int state = LX_START, rule = -1;
+    for(;;) {
+        state = lxNext[state][lxClass[(unsigned char)*p]];
+        if(!state) break;
+        p++;
+        if(lxKernel[state]) p = runKernel(lxKernel[state], p);
+        if(lxAccept[state] >= 0) {
+            rule = lxAccept[state];
+            end = p;
+        }
+    }
+    if(rule < 0) {
+        if(*start == '\0') {
+            addTk(lx, END);
+            lx->end = start;
+            return true;
+        }
+        return lexFail(lx, start, "Invalid character: %c (ASCII %d)", *start, *start);
+    }
+    const LexRule *r = &lxRules[rule];
+    switch(r->kind) {
+        case LX_TOKEN:
+            if(!addMatch(lx, r->code, start, end)) return false;
+            break;
+        case LX_ERROR:
+            return lexFail(lx, start, "%s", r->msg);
+    }
+    // a line ends only at \n, so \r\n is counted once and a single \r is a blank
+    // the token keeps its start line, and the lines inside it are counted for the next ones
+    if(r->lines) lx->line += countNewlines(start, end);
+    *ppch = end;
+    return true;
+}
+
+// lexes from pch until END or lx->stop; returns false on error
+static bool lexRange(Lexer *lx, const char *pch) {
+    while(!lx->end) {
+        if(!lexStep(lx, &pch)) return false;
+    }
+    return true;
+}
+
+Token *tokenize(InternPool *names, const char *pch, int *nTokens) {
+    scanInit();
+    Lexer lx = {.src = pch, .names = names, .line = 1};
+    if(!lexRange(&lx, pch)) {
+        free(lx.tokens);
+        err("%s", lx.errMsg);
+    }
+    if(nTokens) *nTokens = lx.nTokens;
+    return lx.tokens;
+}
+
+// Threaded lexing
+// The lexer runs on its own thread and publishes batches of tokens in a lock-free ring with one producer
+// (the lexer thread) and one consumer (the thread which calls nextToken). The producer lexes directly into
+// a free batch and publishes it by advancing head; the consumer frees a batch by advancing tail.
+// Only the lexer thread adds names to the intern pool, and a name is published with its batch.
+#define TK_BATCH 1024       // the number of tokens in a batch
+#define TK_QUEUE 8          // the number of batches in the ring
+
+typedef struct {
+    Token tokens[TK_BATCH];
+    int n;                  // the number of tokens in the batch
+    bool failed;            // the lexing stopped with an error after the tokens
+    bool last;              // the last batch, which ends with END or with the error
+} TkBatch;
+
+// On-demand lexing
+// the stream keeps only the token returned last, so the memory does not depend on the source size
+struct TkStream {
+    Lexer lx;
+    const char *pos;
+    // the threaded mode (see lexBeginThread)
+    TkBatch *queue;         // NULL if the tokens are lexed by nextToken
+    atomic_uint head;       // the number of batches published by the producer
+    atomic_uint tail;       // the number of batches released by the consumer
+    atomic_bool stop;       // set by lexEnd, to stop the producer before END
+    TkBatch *batch;         // the batch which is read by the consumer, or NULL
+    int batchPos;           // the next token from batch
+    pthread_t thread;
+    bool joined;            // the lexer thread ended and was joined
+    char threadErr[256];
+};
+
+TkStream *lexBegin(InternPool *names, const char *pch) {
+    scanInit();
+    TkStream *s = safeAlloc(sizeof(TkStream));
+    memset(s, 0, sizeof(TkStream));
+    s->lx = (Lexer){.src = pch, .names = names, .line = 1};
+    // a step adds at most one token
+    s->lx.tokens = safeAlloc(sizeof(Token));
+    s->lx.capTokens = 1;
+    s->pos = pch;
+    return s;
+}
+
+static Token nextQueued(TkStream *s);
+
+Token nextToken(TkStream *s) {
+    if(s->queue) return nextQueued(s);
+    if(!s->lx.end) {
+        s->lx.nTokens = 0;
+        do {
+            if(!lexStep(&s->lx, &s->pos)) err("%s", s->lx.errMsg);
+        } while(!s->lx.nTokens);
+    }
+    return s->lx.tokens[0];
+}
+
+// the other thread runs while this one waits, even on a single CPU
+static void waitWhile(atomic_uint *a, unsigned value) {
+    while(atomic_load_explicit(a, memory_order_acquire) == value) sched_yield();
+}
+
+static void *lexThread(void *arg) {
+    TkStream *s = arg;
+    const char *pch = s->pos;
+    Lexer lx = {.src = s->lx.src, .names = s->lx.names, .line = 1};
+    for(unsigned head = 0; ; head++) {
+        // a batch can be reused only after the consumer released it
+        if(head >= TK_QUEUE) {
+            while(atomic_load_explicit(&s->tail, memory_order_acquire) == head - TK_QUEUE) {
+                if(atomic_load_explicit(&s->stop, memory_order_relaxed)) return NULL;
+                sched_yield();
+            }
+        }
+        TkBatch *b = &s->queue[head % TK_QUEUE];
+        // a step adds at most one token, so the batch is never reallocated
+        lx.tokens = b->tokens;
+        lx.capTokens = TK_BATCH;
+        lx.nTokens = 0;
+        b->failed = false;
+        while(lx.nTokens < TK_BATCH && !lx.end) {
+            if(!lexStep(&lx, &pch)) {
+                strcpy(s->threadErr, lx.errMsg);
+                b->failed = true;
                 break;
             }
-            case '\'': { // Char literal
-                if(pch[1] == '\0' || pch[2] != '\'') err("Invalid char literal");
-                Token *tk = addTk(CHAR);
-                tk->c = pch[1];
-                pch += 3;
+        }
+        b->n = lx.nTokens;
+        b->last = b->failed || lx.end;
+        atomic_store_explicit(&s->head, head + 1, memory_order_release);
+        if(b->last) return NULL;
+    }
+}
+
+TkStream *lexBeginThread(InternPool *names, const char *pch) {
+    TkStream *s = lexBegin(names, pch);
+    s->queue = safeAlloc(TK_QUEUE * sizeof(TkBatch));
+    if(pthread_create(&s->thread, NULL, lexThread, s)) {
+        lexEnd(s);
+        err("cannot create the lexer thread");
+    }
+    return s;
+}
+
+static Token nextQueued(TkStream *s) {
+    for(;;) {
+        if(!s->batch) {
+            unsigned tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+            waitWhile(&s->head, tail);
+            s->batch = &s->queue[tail % TK_QUEUE];
+            s->batchPos = 0;
+            if(s->batch->last && !s->joined) {
+                pthread_join(s->thread, NULL);
+                s->joined = true;
+            }
+        }
+        TkBatch *b = s->batch;
+        if(s->batchPos < b->n) return b->tokens[s->batchPos++];
+        if(b->failed) err("%s", s->threadErr);
+        if(b->last) return b->tokens[b->n - 1];
+        s->batch = NULL;
+        atomic_fetch_add_explicit(&s->tail, 1, memory_order_release);
+    }
+}
+
+void lexEnd(TkStream *s) {
+    if(s->queue && !s->joined) {
+        atomic_store(&s->stop, true);
+        pthread_join(s->thread, NULL);
+    }
+    free(s->queue);
+    free(s->lx.tokens);
+    free(s);
+}
+
+// Parallel lexing
+// The source is split in chunks which start after a \n. Each chunk is lexed speculatively, as if its start
+// is outside of any token, with the lines counted from 0 and the IDs not interned. Then the chunks are stitched
+// in order: the previous chunk stopped at the first match which starts at or after this chunk's start, at
+// position pos. If pos is one of the first match boundaries of this chunk, the chunk's tokens from that boundary
+// on are exactly the ones of the serial lexer. Else (ex: a string which contains the chunk's start)
+// the chunk is lexed again serially from pos. The stitching also adds the line of the chunk's start and interns
+// the IDs in order, so the result is identical to the one of tokenize.
+
+#define MIN_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+    const char *begin, *stop;   // the chunk is [begin,stop)
+    int nLines;                 // the number of \n in [begin,stop)
+    Lexer lx;
+    bool ok;
+} Chunk;
+
+static void lexChunk(void *arg, int i) {
+    Chunk *c = &((Chunk *)arg)[i];
+    c->nLines = countNewlines(c->begin, c->stop);
+    c->lx.stop = *c->stop ? c->stop : NULL;
+    c->lx.deferIntern = true;
+    c->lx.maxBounds = MAX_BOUNDS;
+    c->ok = lexRange(&c->lx, c->begin);
+}
+
+// appends the tokens [from,lx->nTokens) of a chunk to all, adding lineBase to their lines and interning the IDs
+static void appendChunk(Lexer *all, const Lexer *lx, int from, int lineBase) {
+    for(int i = from; i < lx->nTokens; i++) {
+        Token *tk = addTk(all, lx->tokens[i].code);
+        *tk = lx->tokens[i];
+        tk->line += lineBase;
+        if(tk->code == ID && lx->deferIntern) {
+            const char *begin = all->src + tk->span.off;
+            tk->text = intern(all->names, begin, begin + tk->span.len);
+        }
+    }
+}
+
+// frees the tokens of the chunks [from,n), the tokens of all and the chunks, then calls err with msg
+// msg is copied first, because it can be in a chunk
+static noreturn void chunksFail(Chunk *chunks, int from, int n, Lexer *all, const char *msg) {
+    char errMsg[sizeof(all->errMsg)];
+    strcpy(errMsg, msg);
+    for(int i = from; i < n; i++) free(chunks[i].lx.tokens);
+    free(chunks);
+    free(all->tokens);
+    err("%s", errMsg);
+}
+
+Token *tokenizeParallel(InternPool *names, const char *pch, int nThreads, int *nTokens) {
+    size_t len = strlen(pch);
+    int nChunks = nThreads * 4;
+    if(nThreads <= 1 || len < (size_t)nChunks * MIN_CHUNK_SIZE / 4) return tokenize(names, pch, nTokens);
+    scanInit();
+
+    // the chunks start after a \n
+    Chunk *chunks = safeAlloc(nChunks * sizeof(Chunk));
+    memset(chunks, 0, nChunks * sizeof(Chunk));
+    const char *begin = pch;
+    int n = 0;
+    for(int i = 0; i < nChunks && *begin; i++) {
+        const char *stop = begin + len / nChunks;
+        if(stop >= pch + len || i == nChunks - 1) {
+            stop = pch + len;
+        } else {
+            stop = findLineEnd(stop);
+            if(*stop) stop++;
+        }
+        chunks[n].begin = begin;
+        chunks[n].stop = stop;
+        chunks[n++].lx.src = pch;
+        begin = stop;
+    }
+
+    Pool *pool = poolNew(nThreads);
+    poolFor(pool, n, lexChunk, chunks);
+    poolFree(pool);
+
+    Lexer all = {.src = pch, .names = names, .line = 1};
+    all.capTokens = 1024;
+    for(int i = 0; i < n; i++) all.capTokens += chunks[i].lx.nTokens;
+    all.tokens = safeAlloc(all.capTokens * sizeof(Token));
+    const char *pos = pch;      // where the serial lexing would be now
+    int lineBase = 1;           // the line of chunks[i].begin
+    for(int i = 0; i < n; i++) {
+        Chunk *c = &chunks[i];
+        int from = -1;
+        for(int b = 0; b < c->lx.nBounds; b++) {
+            if(c->lx.bounds[b] == pos) {
+                from = c->lx.boundTks[b];
                 break;
             }
-            default:
-                if(isalpha(*pch) || *pch == '_') { // Identifiers/keywords
-                    start = pch++;
-                    while(isalnum(*pch) || *pch == '_') pch++;
-                    char *text = extract(start, pch);
-                    
-                    // Keyword checks
-                    if(strcmp(text, "char") == 0) addTk(TYPE_CHAR);
-                    else if(strcmp(text, "double") == 0) addTk(TYPE_DOUBLE);
-                    else if(strcmp(text, "else") == 0) addTk(ELSE);
-                    else if(strcmp(text, "if") == 0) addTk(IF);
-                    else if(strcmp(text, "int") == 0) addTk(TYPE_INT);
-                    else if(strcmp(text, "return") == 0) addTk(RETURN);
-                    else if(strcmp(text, "struct") == 0) addTk(STRUCT);
-                    else if(strcmp(text, "void") == 0) addTk(VOID);
-                    else if(strcmp(text, "while") == 0) addTk(WHILE);
-                    else {
-                        Token *tk = addTk(ID);
-                        tk->text = text;
-                    }
-                }
-                else if(isdigit(*pch)) { // Numbers
-                    start = pch;
-                    int isDouble = 0;
-                    while(isdigit(*pch) || *pch == '.' || 
-                          tolower(*pch) == 'e' || *pch == '+' || *pch == '-') {
-                        if(*pch == '.' || tolower(*pch) == 'e' || tolower(*pch)=='E') isDouble = 1;
-                            pch++;
-                            
-                        // if it contains a letter that is not e or E => error
-                        if(isalpha(*pch) && tolower(*pch) != 'e') {
-                            err("Invalid number format: %.*s", (int)(pch - start), start);
-                        }
-
-                        // check if a + or - has before it an e or E 
-                        if ((*pch == '+' || *pch == '-') && tolower(*(pch - 1)) != 'e') {
-                            err("Invalid number format: %.*s", (int)(pch - start), start);
-                        }
-
-                        // check if e or E has before it a number
-                        if ((*pch == 'e' || *pch == 'E') && !isdigit(*(pch - 1))) {
-                            err("Invalid number format: %.*s", (int)(pch - start), start);
-                        }
-                        
-                    }
-                    
-                    // not a valid number if it ends with . or e or E or + or -
-                    if (*(pch - 1) == '.' || tolower(*(pch - 1)) == 'e' || *(pch - 1) == '+' || *(pch - 1) == '-') {
-                        err("Invalid number format: %.*s", (int)(pch - start), start);
-                    }
-
-                    char *numStr = extract(start, pch);
-
-                    Token *tk = addTk(isDouble ? DOUBLE : INT);
-                    if(isDouble) tk->d = atof(numStr);
-                    else tk->i = atoi(numStr);
-                    free(numStr);
-                }
-                else {
-                    err("Invalid character: %c (ASCII %d)", *pch, *pch);
-                }
         }
+        // an error before the synchronisation point may come from a wrong speculation
+        if(from >= 0 && (c->ok || c->lx.errPos >= pos)) {
+            if(!c->ok) chunksFail(chunks, i, n, &all, c->lx.errMsg);
+            appendChunk(&all, &c->lx, from, lineBase);
+            pos = c->lx.end;
+        } else if(pos < c->stop || (i == n - 1 && all.tokens[all.nTokens - 1].code != END)) {
+            // lexes the chunk again from pos, with the real lines and IDs
+            Lexer lx = {.src = pch, .names = names, .line = lineBase + countNewlines(c->begin, pos)};
+            lx.stop = *c->stop ? c->stop : NULL;
+            if(!lexRange(&lx, pos)) {
+                free(lx.tokens);
+                chunksFail(chunks, i, n, &all, lx.errMsg);
+            }
+            appendChunk(&all, &lx, 0, 0);
+            pos = lx.end;
+            free(lx.tokens);
+        }
+        lineBase += c->nLines;
+        free(c->lx.tokens);
     }
+    free(chunks);
+    if(nTokens) *nTokens = all.nTokens;
+    return all.tokens;
 }
 
-void showTokens(const Token *tokens) {
+// Incremental lexing
+// An edit at offset off can change only the matches which read chars from off on. A match which ends at end reads
+// the chars until end+LX_MAX_OVERRUN, so all the matches before a token which starts before off-LX_MAX_OVERRUN
+// are not changed, and the lexing starts again from that token. The new tokens are put in the gap, while the old
+// tokens after the gap are dropped as the lexing passes them. When the lexing reaches, after the inserted chars,
+// the start of an old token, it continues exactly as before, so the rest of the old tokens are kept.
+
+// adds dOff to the offsets of a token and dLine to its line
+static void tkShift(Token *tk, int *off, int dOff, int dLine) {
+    *off += dOff;
+    tk->line += dLine;
+    if(tk->code == STRING) tk->span.off += dOff;
+}
+
+int tkSeqCount(const TkSeq *seq) {
+    return seq->capTokens - (seq->gapEnd - seq->gapBegin);
+}
+
+Token tkSeqGet(const TkSeq *seq, int i, int *off) {
+    if(i < seq->gapBegin) {
+        if(off) *off = seq->offs[i];
+        return seq->tokens[i];
+    }
+    i += seq->gapEnd - seq->gapBegin;
+    Token tk = seq->tokens[i];
+    int tkOff = seq->offs[i];
+    tkShift(&tk, &tkOff, seq->len, seq->nLines);
+    if(off) *off = tkOff;
+    return tk;
+}
+
+// moves the gap before the token i
+static void moveGap(TkSeq *seq, int i) {
+    while(seq->gapBegin > i) {
+        int from = --seq->gapBegin, to = --seq->gapEnd;
+        seq->tokens[to] = seq->tokens[from];
+        seq->offs[to] = seq->offs[from];
+        tkShift(&seq->tokens[to], &seq->offs[to], -seq->len, -seq->nLines);
+    }
+    while(seq->gapBegin < i) {
+        int from = seq->gapEnd++, to = seq->gapBegin++;
+        seq->tokens[to] = seq->tokens[from];
+        seq->offs[to] = seq->offs[from];
+        tkShift(&seq->tokens[to], &seq->offs[to], seq->len, seq->nLines);
+    }
+}
+
+// adds a token at the start of the gap
+static void addToGap(TkSeq *seq, const Token *tk, int off) {
+    if(seq->gapBegin == seq->gapEnd) {
+        int nAfter = seq->capTokens - seq->gapEnd;
+        int cap = seq->capTokens ? seq->capTokens * 2 : 1024;
+        seq->tokens = safeRealloc(seq->tokens, cap * sizeof(Token));
+        seq->offs = safeRealloc(seq->offs, cap * sizeof(int));
+        memmove(seq->tokens + cap - nAfter, seq->tokens + seq->gapEnd, nAfter * sizeof(Token));
+        memmove(seq->offs + cap - nAfter, seq->offs + seq->gapEnd, nAfter * sizeof(int));
+        seq->gapEnd = cap - nAfter;
+        seq->capTokens = cap;
+    }
+    seq->tokens[seq->gapBegin] = *tk;
+    seq->offs[seq->gapBegin++] = off;
+}
+
+// lexes from the offset pos, which is at the given line, until the lexing is the same as for the tokens after the gap
+// the new chars end at newEnd; returns the number of new tokens, or -1 on error
+static int relex(TkSeq *seq, int pos, int line, int newEnd, int *nDropped) {
+    Token tk;
+    Lexer lx = {.src = seq->src, .names = seq->names, .line = line, .tokens = &tk, .capTokens = 1};
+    const char *pch = seq->src + pos;
+    int nNew = 0;
+    *nDropped = 0;
+    scanInit();
+    for(;;) {
+        int q = (int)(pch - seq->src);
+        // the old tokens which start before q were replaced
+        while(seq->gapEnd < seq->capTokens && seq->offs[seq->gapEnd] + seq->len < q) {
+            seq->gapEnd++;
+            (*nDropped)++;
+        }
+        if(q >= newEnd && seq->gapEnd < seq->capTokens && seq->offs[seq->gapEnd] + seq->len == q) return nNew;
+        lx.nTokens = 0;
+        if(!lexStep(&lx, &pch)) {
+            strcpy(seq->errMsg, lx.errMsg);
+            return -1;
+        }
+        if(lx.nTokens) {
+            addToGap(seq, &tk, q);
+            nNew++;
+        }
+        if(lx.end) return nNew;
+    }
+}
+
+// after an error, there are no tokens
+static bool seqFail(TkSeq *seq) {
+    seq->gapBegin = 0;
+    seq->gapEnd = seq->capTokens;
+    seq->valid = false;
+    return false;
+}
+
+bool tkSeqInit(TkSeq *seq, InternPool *names, const char *src, int len) {
+    memset(seq, 0, sizeof(TkSeq));
+    seq->names = names;
+    seq->cap = len + 1;
+    seq->src = safeAlloc(seq->cap);
+    memcpy(seq->src, src, len);
+    seq->src[len] = '\0';
+    seq->len = len;
+    seq->nLines = countNewlines(seq->src, seq->src + len);
+    int nDropped;
+    seq->valid = relex(seq, 0, 1, 0, &nDropped) >= 0;
+    return seq->valid || seqFail(seq);
+}
+
+bool tkSeqEdit(TkSeq *seq, int off, int removed, const char *ins, int insLen, TkChange *change) {
+    if(off < 0 || removed < 0 || insLen < 0 || off + removed > seq->len) {
+        err("invalid edit: %d chars at offset %d, in a source of %d chars", removed, off, seq->len);
+    }
+    // the first token which can be changed
+    int first = 0, pos = 0, line = 1;
+    if(seq->valid && LX_MAX_OVERRUN >= 0) {
+        // the last token which starts before off-LX_MAX_OVERRUN
+        int lo = 0, hi = tkSeqCount(seq);
+        while(lo < hi) {
+            int mid = (lo + hi) / 2, midOff;
+            tkSeqGet(seq, mid, &midOff);
+            if(midOff + LX_MAX_OVERRUN < off) lo = mid + 1;
+            else hi = mid;
+        }
+        if(lo > 0) {
+            first = lo - 1;
+            line = tkSeqGet(seq, first, &pos).line;
+        }
+    }
+    moveGap(seq, first);
+
+    // the edit of the source; the tokens after the gap are relative to its end, so they remain valid
+    int delta = insLen - removed;
+    if(seq->len + delta + 1 > seq->cap) {
+        seq->cap = (seq->len + delta + 1) * 2;
+        seq->src = safeRealloc(seq->src, seq->cap);
+    }
+    int dLines = countNewlines(ins, ins + insLen) - countNewlines(seq->src + off, seq->src + off + removed);
+    memmove(seq->src + off + insLen, seq->src + off + removed, seq->len - off - removed + 1);
+    memcpy(seq->src + off, ins, insLen);
+    seq->len += delta;
+    seq->nLines += dLines;
+
+    int nDropped;
+    int nNew = relex(seq, pos, line, off + insLen, &nDropped);
+    if(nNew < 0) return seqFail(seq);
+    seq->valid = true;
+    if(change) {
+        change->first = first;
+        change->oldEnd = first + nDropped;
+        change->newEnd = first + nNew;
+    }
+    return true;
+}
+
+void tkSeqFree(TkSeq *seq) {
+    free(seq->src);
+    free(seq->tokens);
+    free(seq->offs);
+    memset(seq, 0, sizeof(TkSeq));
+}
+
+void showTokens(const char *src, const Token *tokens) {
     const char *tokenNames[] = {
         "ID", "TYPE_CHAR", "TYPE_DOUBLE", "ELSE", "IF", "TYPE_INT", "RETURN", 
         "STRUCT", "VOID", "WHILE", "COMMA", "SEMICOLON", "LPAR", "RPAR", 
@@ -246,12 +621,15 @@ void showTokens(const Token *tokens) {
         "LESSEQ", "GREATER", "GREATEREQ", "INT", "DOUBLE", "CHAR", "STRING"
     };
 
-    for(const Token *tk = tokens; tk; tk = tk->next) {
+    for(const Token *tk = tokens; ; tk++) {
         printf("%d\t%s", tk->line, tokenNames[tk->code]);
         switch(tk->code) {
-            case ID: case STRING:
+            case ID:
                 printf(":%s", tk->text);
                 break;
+            case STRING:
+                printf(":%.*s", tk->span.len, src + tk->span.off);
+                break;
             case INT:
                 printf(":%d", tk->i);
                 break;
@@ -263,5 +641,6 @@ void showTokens(const Token *tokens) {
                 break;
         }
         printf("\n");
+        if(tk->code == END) break;
     }
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
+#include "intern.h"
+
 // enum{
 // 	ID
 // 	// keywords
@@ -23,17 +26,92 @@ enum {
 	INT, DOUBLE, CHAR, STRING
 };
 
-typedef struct Token{
+// a token is stored by value in a contiguous array, so it has no link to the next token
+// the chars for ID are interned (see intern.h) and a STRING keeps only its position in the source,
+// so the source must remain in memory while its tokens are used
+typedef struct{
 	int code;		// ID, TYPE_CHAR, ...
 	int line;		// the line from the input file
 	union{
-		char *text;		// the chars for ID, STRING (dynamically allocated)
+		const char *text;		// the chars for ID (interned)
+		struct{
+			int off;		// the offset in source of the first char after the opening "
+			int len;		// the number of chars, without the quotes
+			}span;		// the chars for STRING
 		int i;		// the value for INT
 		char c;		// the value for CHAR
 		double d;		// the value for DOUBLE
 		};
-	struct Token *next;		// next token in a simple linked list
 	}Token;
 
-Token *tokenize(const char *pch);
-void showTokens(const Token *tokens);
+// returns an array of tokens, which always ends with an END token
+// the IDs are interned in names; if nTokens is not NULL, it is set with the number of tokens, including END
+// on a lexical error it calls err
+// the lines end only at \n, so \r\n is a single line end and a lone \r (old Mac files) is a blank
+Token *tokenize(InternPool *names, const char *pch, int *nTokens);
+// the same as tokenize, but large sources are split in chunks which are lexed on nThreads threads
+// the result is identical to the one of tokenize
+Token *tokenizeParallel(InternPool *names, const char *pch, int nThreads, int *nTokens);
+
+// the state of an on-demand lexing
+typedef struct TkStream TkStream;
+// starts the on-demand lexing of pch, which is an alternative to tokenize
+TkStream *lexBegin(InternPool *names, const char *pch);
+// the same as lexBegin, but the source is lexed on a new thread while the tokens are read with nextToken
+// until the END token or lexEnd, the other threads must not add names to names
+TkStream *lexBeginThread(InternPool *names, const char *pch);
+// lexes and returns the next token from the stream
+// after the END token, it returns END again; on a lexical error it calls err, like tokenize
+Token nextToken(TkStream *s);
+// ends the lexing, even if END was not reached, and frees the stream
+void lexEnd(TkStream *s);
+
+// returns a new '\0' terminated copy of the chars of a STRING from src, allocated in the arena a
+// it is needed only by the phases which must have the chars as a C string
+const char *tkString(Arena *a, const char *src, const Token *tk);
+void showTokens(const char *src, const Token *tokens);
+
+// Incremental lexing
+// a token sequence of a source which is edited (ex: in an editor)
+// after an edit, only the tokens around it are lexed again, until the new tokens are the same as the old ones
+// the fields are used only by the tkSeq functions
+typedef struct{
+	InternPool *names;		// the pool of the IDs
+	char *src;		// a copy of the source, '\0' terminated
+	int len;		// the length of src
+	int cap;		// the allocated size of src
+	int nLines;		// the number of '\n' in src
+	// the tokens and their offsets in src are in a gap buffer: the gap is at the last edit,
+	// the tokens before it keep their line and offset, and the tokens after it keep them relative to the end of src
+	// (line-nLines and offset-len), so an edit does not change the tokens after it
+	Token *tokens;
+	int *offs;
+	int capTokens;
+	int gapBegin,gapEnd;		// the gap is [gapBegin,gapEnd)
+	bool valid;		// false after a lexical error; then there are no tokens and the next edit lexes all the source
+	char errMsg[256];		// the lexical error
+	}TkSeq;
+
+// the result of an edit: the tokens [first,oldEnd) were replaced with the tokens [first,newEnd)
+// the tokens after them are the same, but their lines and offsets can be changed by the edit
+typedef struct{
+	int first;
+	int oldEnd;
+	int newEnd;
+	}TkChange;
+
+// copies the len chars from src and lexes them, with the IDs interned in names
+// returns false on a lexical error, with the message in seq->errMsg
+bool tkSeqInit(TkSeq *seq,InternPool *names,const char *src,int len);
+// replaces the removed chars from offset off with the insLen chars from ins and updates the tokens
+// if change is not NULL, it is set with the changed tokens
+// returns false on a lexical error, with the message in seq->errMsg; the edit is applied to the source anyway
+// the time depends on the size of the edit and on its distance to the previous edit, but not on the source size,
+// except for moving the chars after the edit in src
+bool tkSeqEdit(TkSeq *seq,int off,int removed,const char *ins,int insLen,TkChange *change);
+// the number of tokens, including END
+int tkSeqCount(const TkSeq *seq);
+// returns the token i and, if off is not NULL, its offset in seq->src
+// the STRING spans are relative to seq->src
+Token tkSeqGet(const TkSeq *seq,int i,int *off);
+void tkSeqFree(TkSeq *seq);
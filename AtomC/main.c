@@ -2,39 +2,150 @@
 #include "utils.h"
 #include "parser.h"
 #include "ad.h"
+#include "pool.h"
+#include "driver.h"
+#include "prelude.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// adds to *files the names from a response file, separated by whitespace
+// the names are kept in the file's content, which is returned
+static char *addResponseFile(const char ***files, int *nFiles, int *cap, const char *respName) {
+    char *text = loadFile(respName);
+    for (char *pch = strtok(text, " \t\r\n"); pch; pch = strtok(NULL, " \t\r\n")) {
+        if (*nFiles == *cap) {
+            *cap = *cap ? *cap * 2 : 64;
+            *files = safeRealloc(*files, *cap * sizeof(const char *));
+        }
+        (*files)[(*nFiles)++] = pch;
+    }
+    return text;
+}
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        printf("Usage: %s <input_file>\n", argv[0]);
+    // -mmap: maps the input files in memory instead of reading them
+    // -j N: lexes large files and analyses their function bodies on N threads (0 - one for each CPU)
+    //       the whole file is lexed first, so a lexical error is reported before any error of the parse
+    //       for many files, compiles N files at the same time (default: one for each CPU)
+    // -pipe: lexes on a separate thread, while parsing
+    // -stats: shows statistics about the parsing
+    // -ast: shows the AST built by the parser
+    // -prelude file: uses the global domain saved in file (see prelude.h) instead of the extern functions
+    // -save-prelude file: saves the global domain of the compiled file in file, to be used with -prelude
+    // @file: compiles the files whose names are in file
+    bool useMmap = false, usePipe = false, showStats = false, showTree = false;
+    const char *preludeName = NULL, *savePreludeName = NULL;
+    int nThreads = 0;
+    const char **files = NULL;
+    int nFiles = 0, filesCap = 0;
+    char *respText = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-mmap")) {
+            useMmap = true;
+        } else if (!strcmp(argv[i], "-pipe")) {
+            usePipe = true;
+        } else if (!strcmp(argv[i], "-stats")) {
+            showStats = true;
+        } else if (!strcmp(argv[i], "-ast")) {
+            showTree = true;
+        } else if (!strcmp(argv[i], "-prelude") && i + 1 < argc) {
+            preludeName = argv[++i];
+        } else if (!strcmp(argv[i], "-save-prelude") && i + 1 < argc) {
+            savePreludeName = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            nThreads = atoi(argv[++i]);
+            if (nThreads <= 0) nThreads = cpuCount();
+        } else if (argv[i][0] == '@' && !respText) {
+            respText = addResponseFile(&files, &nFiles, &filesCap, argv[i] + 1);
+        } else {
+            if (nFiles == filesCap) {
+                filesCap = filesCap ? filesCap * 2 : 64;
+                files = safeRealloc(files, filesCap * sizeof(const char *));
+            }
+            files[nFiles++] = argv[i];
+        }
+    }
+    if (!nFiles) {
+        printf("Usage: %s [-mmap] [-j N | -pipe] [-stats] [-ast] [-prelude <file>] [-save-prelude <file>] <input_file>\n",
+            argv[0]);
+        printf("       %s [-mmap] [-j N] [-prelude <file>] <input_file>... | @<file_with_names>\n", argv[0]);
         return 1;
     }
+    Prelude prelude;
+    if (preludeName) preludeLoad(&prelude, preludeName);
+    if (nFiles > 1 || respText) {
+        // the files are compiled in parallel and only their results are shown
+        int nErrors = compileFiles(files, nFiles, nThreads, useMmap, preludeName ? &prelude : NULL);
+        free(files);
+        free(respText);
+        if (preludeName) preludeFree(&prelude);
+        return nErrors ? 1 : 0;
+    }
+    const char *fileName = files[0];
+    free(files);
     
+    // the names of the unit, over the ones of the prelude
+    InternPool names;
+    internInit(&names, preludeName ? &prelude.names : NULL);
+
     // Initialize domain analysis first
-    pushDomain(); // Create global domain
+    SymTable st;
+    symTableInit(&st, preludeName ? &prelude.st : NULL);
+    pushDomain(&st); // Create global domain
     
-    // Then initialize virtual machine
-    vmInit();
+    // Then initialize virtual machine; with a prelude, the extern functions are in its domain
+    if (!preludeName) vmInit(&st, &names);
 
     printf("virtual machine initialized\n");
-    char *src = loadFile(argv[1]); // Load the input file
-    Token *tokens = tokenize(src); // Generate tokens
+    SrcFile src;
+    if (useMmap) {
+        src = mapFile(fileName); // Map the input file
+    } else {
+        src = (SrcFile){loadFile(fileName), 0, false}; // Load the input file
+    }
+    Parser p;
+    parserInit(&p, &st, &names);
+    bool ok;
+    if (nThreads > 1) {
+        int nTokens;
+        Token *tokens = tokenizeParallel(&names, src.data, nThreads, &nTokens); // Generate tokens
 
-    // Optional: display tokens
-    //showTokens(tokens);
+        // Optional: display tokens
+        //showTokens(src.data, tokens);
+        
+        // Parse and perform domain analysis
+        p.pool = poolNew(nThreads);
+        ok = parse(&p, src.data, tokens);
+        poolFree(p.pool);
+        p.pool = NULL;
+        free(tokens);
+    } else {
+        // the tokens are generated while parsing, so only a few of them are in memory
+        ok = parseSource(&p, src.data, usePipe);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s\n", p.errMsg);
+        return 1;
+    }
     
-    // Parse and perform domain analysis
-    // Use the parser API properly
-    parse(tokens);
+    if (savePreludeName) {
+        preludeSave(savePreludeName, &st);
+        printf("prelude saved in %s\n", savePreludeName);
+        return 0;
+    }
     
     // Display symbol table
-    showDomain(symTable, "global");
+    showDomain(st.top, "global");
+    if (showTree) showAst(&p.ast, p.ast.root, 0);
     
     printf("Input is syntactically and semantically correct\n");
+    if (showStats) printf("backtracks: %d\n", p.nBacktracks);
 
-    free(src); // Free allocated memory
+    parserFree(&p);
+    unmapFile(&src); // Free allocated memory
     
     return 0;
 }
\ No newline at end of file
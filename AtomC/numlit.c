@@ -0,0 +1,62 @@
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "numlit.h"
+#include "scan.h"
+
+int parseInt(const char *begin, const char *end) {
+    unsigned v = 0;
+    for(; begin != end; begin++) {
+        v = v * 10 + (unsigned)(*begin - '0');
+    }
+    return (int)v;
+}
+
+// the powers of 10 which are exactly represented as double
+static const double exactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// The fast path (Clinger): if the decimal digits give an integer m <= 2^53 and the decimal exponent e
+// is in [-22,22], both m and 10^|e| are exact doubles, so a single IEEE multiplication or division gives
+// the correctly rounded result, the same as strtod. The other cases are rare in source code and are given to strtod.
+// The fast path requires the double operations to be done without extra precision (FLT_EVAL_METHOD==0).
+double parseDouble(const char *begin, const char *end) {
+#if FLT_EVAL_METHOD == 0
+    const char *p = begin;
+    uint64_t m = 0;
+    int nDigits = 0;    // the significant digits from m
+    int exp10 = 0;
+    for(; p != end && isDigit(*p); p++) {
+        if(nDigits || *p != '0') nDigits++;
+        m = m * 10 + (uint64_t)(*p - '0');
+    }
+    if(p != end && *p == '.') {
+        for(p++; p != end && isDigit(*p); p++) {
+            if(nDigits || *p != '0') nDigits++;
+            m = m * 10 + (uint64_t)(*p - '0');
+            exp10--;
+        }
+    }
+    if(p != end) {    // e or E
+        p++;
+        bool negative = *p == '-';
+        if(*p == '+' || *p == '-') p++;
+        int e = 0;
+        for(; p != end && e < 10000; p++) e = e * 10 + (*p - '0');
+        exp10 += negative ? -e : e;
+    }
+    // with at most 19 digits m did not overflow
+    if(nDigits <= 19 && m <= (UINT64_C(1) << 53)) {
+        if(m == 0) return 0.0;
+        if(exp10 >= 0 && exp10 <= 22) return (double)m * exactPow10[exp10];
+        if(exp10 < 0 && exp10 >= -22) return (double)m / exactPow10[-exp10];
+    }
+#endif
+    // the chars after the atom cannot continue a number, so strtod stops exactly at end
+    (void)end;
+    return strtod(begin, NULL);
+}
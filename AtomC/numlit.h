@@ -0,0 +1,11 @@
+#pragma once
+
+// conversion of the numeric atoms directly from their chars in source, without temporary strings
+
+// returns the value of an INT atom from [begin,end), which has only decimal digits
+// like atoi, a value which does not fit in int is truncated
+int parseInt(const char *begin, const char *end);
+
+// returns the value of a DOUBLE atom from [begin,end)
+// the result is always the same as the one given by strtod
+double parseDouble(const char *begin, const char *end);
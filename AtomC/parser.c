@@ -3,267 +3,411 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "parser.h"
 #include "ad.h"
 #include "at.h"    // Added for type analysis
 #include "utils.h"
 
-Token *iTk;        // the iterator in the tokens list
-Token *consumedTk; // the last consumed token
-Symbol *owner = NULL; // current owner symbol (struct or fn)
+// The tokens are pulled from the lexer only when the parser needs them, and are kept in a ring of blocks.
+// The parser backtracks only inside a top-level item, so after each item of unit the tokens before it
+// are retired and their blocks are reused. The blocks are never moved, so a Token pointer remains valid
+// until its token is retired, and the ring grows only for an item which is larger than all its blocks.
+#define TK_BLOCK 256       // the number of tokens in a block
 
-void tkerr(const char *fmt,...){
-    fprintf(stderr,"error in line %d: ",iTk->line);
+// doubles the ring, keeping the blocks of the tokens which are not retired
+static void tkRingGrow(Parser *p){
+    int newSize = p->tkRingSize ? p->tkRingSize * 2 : 4;
+    Token **newRing = safeAlloc(newSize * sizeof(Token *));
+    memset(newRing, 0, newSize * sizeof(Token *));
+    for(int b = p->tkFirst / TK_BLOCK; b < (p->tkPulled + TK_BLOCK - 1) / TK_BLOCK; b++){
+        Token **slot = &p->tkRing[b & (p->tkRingSize - 1)];
+        newRing[b & (newSize - 1)] = *slot;
+        *slot = NULL;
+    }
+    for(int i = 0; i < p->tkRingSize; i++) free(p->tkRing[i]);
+    free(p->tkRing);
+    p->tkRing = newRing;
+    p->tkRingSize = newSize;
+}
+
+static void tkPull(Parser *p){
+    int b = p->tkPulled / TK_BLOCK;
+    if(p->tkPulled % TK_BLOCK == 0){
+        // the slot of a new block holds a retired block or nothing
+        if(b - p->tkFirst / TK_BLOCK >= p->tkRingSize) tkRingGrow(p);
+        Token **slot = &p->tkRing[b & (p->tkRingSize - 1)];
+        if(!*slot) *slot = safeAlloc(TK_BLOCK * sizeof(Token));
+    }
+    Token *tk = &p->tkRing[b & (p->tkRingSize - 1)][p->tkPulled % TK_BLOCK];
+    if(p->tkArray){
+        *tk = p->tkArray[p->tkArrayPos];
+        if(tk->code != END) p->tkArrayPos++;
+    }else{
+        *tk = nextToken(p->stream);
+    }
+    p->tkPulled++;
+}
+
+Token *tkAt(Parser *p, int i){
+    while(i >= p->tkPulled) tkPull(p);
+    return &p->tkRing[(i / TK_BLOCK) & (p->tkRingSize - 1)][i % TK_BLOCK];
+}
+
+// moves to the token i of p->tkArray, retiring all the tokens before it, so they are not pulled
+static void tkStartAt(Parser *p, int i){
+    if(!p->tkRingSize){
+        p->tkFirst = p->tkPulled = 0;
+        tkRingGrow(p);
+    }
+    p->iTk = p->tkFirst = p->tkPulled = p->tkArrayPos = i;
+    p->maxConsumedTk = i - 1;
+    // the block of i can be new and tkPull allocates only at the beginning of a block
+    Token **slot = &p->tkRing[(i / TK_BLOCK) & (p->tkRingSize - 1)];
+    if(!*slot) *slot = safeAlloc(TK_BLOCK * sizeof(Token));
+}
+
+void tkerr(Parser *p, const char *fmt,...){
+    char msg[256];
+    int n = snprintf(msg, sizeof(msg), "error in line %d: ", tkAt(p, p->iTk)->line);
     va_list va;
     va_start(va,fmt);
-    vfprintf(stderr,fmt,va);
+    vsnprintf(msg + n, sizeof(msg) - n, fmt, va);
     va_end(va);
-    fprintf(stderr,"\n");
-    exit(EXIT_FAILURE);
+    errThrow(msg);
 }
 
-bool consume(int code){
-    if(iTk->code==code){
-        consumedTk=iTk;
-        iTk=iTk->next;
+bool consume(Parser *p, int code){
+    if(tkAt(p, p->iTk)->code==code){
+        if(p->iTk<=p->maxConsumedTk) p->nBacktracks++;
+        else p->maxConsumedTk=p->iTk;
+        p->consumedTk=p->iTk++;
         return true;
     }
     return false;
 }
 
+// allocates a symbol of p->owner, which remains in the owner's list after its domain is dropped
+static Symbol *newOwnedSymbol(Parser *p, const char *name, SymKind kind){
+    // a body analysed in parallel uses its own arena, which is moved to the unit's domain at the end
+    Arena *a = p->unitDomain ? &p->lasting : &p->owner->domain->lasting;
+    Symbol *s = allocSymbol(a, name, kind);
+    s->owner = p->owner;
+    return s;
+}
+
+// true if d is the unit's domain or one of the domains under it
+static bool inUnitScope(Parser *p, Domain *d){
+    for(Domain *u = p->unitDomain; u; u = u->parent){
+        if(u == d) return true;
+    }
+    return false;
+}
+
+// searches a symbol like findSymbol, but skips the globals which are not visible yet in a body analysed in parallel
+static Symbol *findVisible(Parser *p, const char *name){
+    for(const SymTable *st = p->st; st; st = st->base){
+        for(Symbol *s = findSymbolChain(st, name); s; s = s->shadowed){
+            if(s->domain == p->unitDomain && s->defIdx >= p->nVisible) continue;
+            // in the table of the unit, a body sees only the symbols of the unit's domain and of the ones under it
+            if(p->unitDomain && st == p->st->base && !inUnitScope(p, s->domain)) continue;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static Node *node(Parser *p, NodeId n){
+    return &p->ast.nodes[n];
+}
+
+// a node with the child a
+static NodeId newNode1(Parser *p, NodeKind kind, int line, NodeId a){
+    NodeId n = astNew(&p->ast, kind, line);
+    node(p, n)->first = a;
+    return n;
+}
+
+// a node with the children a and b
+static NodeId newNode2(Parser *p, NodeKind kind, int line, NodeId a, NodeId b){
+    NodeId n = newNode1(p, kind, line, a);
+    node(p, a)->next = b;
+    return n;
+}
+
+// sets in the node of an expression the result of its types analysis
+static void setRet(Parser *p, NodeId n, const Ret *r){
+    astSetType(&p->ast, n, &r->type);
+    Node *nd = node(p, n);
+    nd->lval = r->lval;
+    nd->ct = r->ct;
+}
+
+// returns the code of the token i positions after the current one, without consuming it
+static int peek(Parser *p, int i){
+    return tkAt(p, p->iTk+i)->code;
+}
+
+// true if code can start a typeBase
+static bool isTypeStart(int code){
+    return code==TYPE_INT || code==TYPE_DOUBLE || code==TYPE_CHAR || code==STRUCT;
+}
+
+// the number of tokens of the typeBase at the current token: STRUCT ID or a single token
+static int typeBaseLen(Parser *p){
+    return peek(p, 0)==STRUCT ? 2 : 1;
+}
+
+// true if the current token starts a varDef
+// a statement cannot start with a type, so the first token is enough
+static bool isVarDefStart(Parser *p){
+    return isTypeStart(peek(p, 0));
+}
+
 // typeBase: TYPE_INT | TYPE_DOUBLE | TYPE_CHAR | STRUCT ID
-bool typeBase(Type *t){
+bool typeBase(Parser *p, Type *t){
     t->n = -1; // not an array by default
     
-    if(consume(TYPE_INT)){ 
+    if(consume(p, TYPE_INT)){ 
         t->tb = TB_INT;
         return true;
     }
-    if(consume(TYPE_DOUBLE)){
+    if(consume(p, TYPE_DOUBLE)){
         t->tb = TB_DOUBLE;
         return true;
     }
-    if(consume(TYPE_CHAR)){
+    if(consume(p, TYPE_CHAR)){
         t->tb = TB_CHAR;
         return true;
     }
-    if(consume(STRUCT)){
-        if(consume(ID)){
-            Token *tkName = consumedTk;
+    if(consume(p, STRUCT)){
+        if(consume(p, ID)){
+            Token *tkName = tkAt(p, p->consumedTk);
             // Look for struct symbol
-            Symbol *s = findSymbol(tkName->text);
+            Symbol *s = findVisible(p, tkName->text);
             if(!s) {
-                tkerr("structura nedefinita: %s", tkName->text);
+                tkerr(p, "structura nedefinita: %s", tkName->text);
             }
             if(s->kind != SK_STRUCT) {
-                tkerr("%s is not a struct", tkName->text);
+                tkerr(p, "%s is not a struct", tkName->text);
             }
             t->tb = TB_STRUCT;
             t->s = s;
             return true;
         }
-        tkerr("missing struct identifier");
+        tkerr(p, "missing struct identifier");
     }
     return false;
 }
 
 // arrayDecl: LBRACKET INT? RBRACKET
-bool arrayDecl(Type *t){
-    if(consume(LBRACKET)){
-        if(consume(INT)) {
-            t->n = consumedTk->i; // Set array size
+bool arrayDecl(Parser *p, Type *t){
+    if(consume(p, LBRACKET)){
+        if(consume(p, INT)) {
+            t->n = tkAt(p, p->consumedTk)->i; // Set array size
         } else {
             t->n = 0; // Array without specified size
         }
         
-        if(consume(RBRACKET)){
+        if(consume(p, RBRACKET)){
             return true;
         }
-        tkerr("missing ]");
+        tkerr(p, "missing ]");
     }
     return false;
 }
 
 // varDef: typeBase ID arrayDecl? SEMICOLON
-bool varDef(){
-    Token *start = iTk;
+NodeId varDef(Parser *p){
     Type t;
+    int line = tkAt(p, p->iTk)->line;
     
-    if(typeBase(&t)){
+    if(typeBase(p, &t)){
         Token *tkName;
-        if(consume(ID)){
-            tkName = consumedTk;
+        if(consume(p, ID)){
+            tkName = tkAt(p, p->consumedTk);
             
-            if(arrayDecl(&t)) {
-                if(t.n == 0) tkerr("a vector variable must have a specified dimension");
+            if(arrayDecl(p, &t)) {
+                if(t.n == 0) tkerr(p, "a vector variable must have a specified dimension");
             }
             
-            if(consume(SEMICOLON)){
+            if(consume(p, SEMICOLON)){
                 // Check for symbol redefinition
-                Symbol *var = findSymbolInDomain(symTable, tkName->text);
-                if(var) tkerr("symbol redefinition: %s", tkName->text);
+                Symbol *var = findSymbolInDomain(p->st, tkName->text);
+                if(var) tkerr(p, "symbol redefinition: %s", tkName->text);
                 
-                // Create new symbol
-                var = newSymbol(tkName->text, SK_VAR);
+                // Create new symbol: the same symbol is in the domain and in the list of its owner
+                var = p->owner ? newOwnedSymbol(p, tkName->text, SK_VAR) : newSymbol(p->st, tkName->text, SK_VAR);
                 var->type = t;
-                var->owner = owner;
-                addSymbolToDomain(symTable, var);
                 
                 // Handle based on owner
-                if(owner){
-                    switch(owner->kind){
+                if(p->owner){
+                    switch(p->owner->kind){
                     case SK_FN:
-                        var->varIdx = symbolsLen(owner->fn.locals);
-                        addSymbolToList(&owner->fn.locals, dupSymbol(var));
+                        var->varIdx = symbolsLen(p->owner->fn.locals);
+                        addSymbolToList(&p->owner->fn.locals, var);
                         break;
                     case SK_STRUCT:
-                        var->varIdx = typeSize(&owner->type);
-                        addSymbolToList(&owner->structMembers, dupSymbol(var));
+                        // the offset is set by layoutStruct, when the struct is complete
+                        if(t.tb == TB_STRUCT && t.s == p->owner) tkerr(p, "the struct %s cannot contain itself", t.s->name);
+                        addSymbolToList(&p->owner->structMembers, var);
                         break;
                     case SK_VAR:  // Added to prevent warning
                     case SK_PARAM: // Added to prevent warning
                         // These cases shouldn't occur as owner
-                        tkerr("invalid owner kind for variable %s", tkName->text);
+                        tkerr(p, "invalid owner kind for variable %s", tkName->text);
                         break;
                     }
                 } else {
-                    var->varMem = safeAlloc(typeSize(&t));
+                    var->varMem = arenaAlloc(&p->st->arena, typeSize(&t));
                 }
+                addSymbolToDomain(p->st, var);
                 
-                return true;
+                NodeId n = astNew(&p->ast, N_VAR, line);
+                node(p, n)->sym = var;
+                astSetType(&p->ast, n, &t);
+                return n;
             }
-            tkerr("missing ; after variable declaration");
+            tkerr(p, "missing ; after variable declaration");
         }
-        // Restore position for other rules
-        iTk = start;
-        return false;
+        tkerr(p, "missing variable name");
     }
-    return false;
+    return 0;
 }
 
 // structDef: STRUCT ID LACC varDef* RACC SEMICOLON
-bool structDef(){
-    Token *start = iTk;
+// it is called only if the current tokens are STRUCT ID LACC
+NodeId structDef(Parser *p){
     Token *tkName;
     Symbol *oldOwner;
+    int line = tkAt(p, p->iTk)->line;
     
-    if(consume(STRUCT)){
-        if(consume(ID)){
-            tkName = consumedTk;
-            if(consume(LACC)){
+    if(consume(p, STRUCT)){
+        if(consume(p, ID)){
+            tkName = tkAt(p, p->consumedTk);
+            if(consume(p, LACC)){
                 // Check for struct redefinition
-                Symbol *s = findSymbolInDomain(symTable, tkName->text);
-                if(s) tkerr("symbol redefinition: %s", tkName->text);
+                Symbol *s = findSymbolInDomain(p->st, tkName->text);
+                if(s) tkerr(p, "symbol redefinition: %s", tkName->text);
                 
                 // Create struct symbol
-                s = newSymbol(tkName->text, SK_STRUCT);
+                s = newSymbol(p->st, tkName->text, SK_STRUCT);
                 s->type.tb = TB_STRUCT;
                 s->type.s = s;
                 s->type.n = -1;
-                addSymbolToDomain(symTable, s);
+                addSymbolToDomain(p->st, s);
+                NodeId n = astNew(&p->ast, N_STRUCT, line), last = 0;
+                node(p, n)->sym = s;
+                astSetType(&p->ast, n, &s->type);
                 
                 // Save previous owner and set new owner
-                oldOwner = owner;
-                owner = s;
-                pushDomain();
+                oldOwner = p->owner;
+                p->owner = s;
+                pushDomain(p->st);
                 
                 // Parse struct members
-                for(;;){
-                    if(!varDef()) break;
+                while(isVarDefStart(p)){
+                    astAppend(&p->ast, n, &last, varDef(p));
                 }
                 
-                if(consume(RACC)){
-                    if(consume(SEMICOLON)){
+                if(consume(p, RACC)){
+                    if(consume(p, SEMICOLON)){
+                        layoutStruct(s);
                         // Restore owner and drop domain
-                        owner = oldOwner;
-                        dropDomain();
-                        return true;
+                        p->owner = oldOwner;
+                        dropDomain(p->st);
+                        return n;
                     }
-                    tkerr("missing ; after struct definition");
+                    tkerr(p, "missing ; after struct definition");
                 }
-                tkerr("missing } after struct body");
-            } 
-            // Not a struct definition
-            iTk = start;
-            return false;
+                tkerr(p, "missing } after struct body");
+            }
+            tkerr(p, "missing { after struct name");
         }
-        tkerr("missing struct identifier");
+        tkerr(p, "missing struct identifier");
     }
-    return false;
+    return 0;
 }
 
 // Forward declarations with return type tracking
-bool exprPrimary(Ret *r);
-bool expr(Ret *r); 
+NodeId exprPrimary(Parser *p, Ret *r);
+NodeId expr(Parser *p, Ret *r); 
 
 // exprPostfix: exprPostfix LBRACKET expr RBRACKET
 //           | exprPostfix DOT ID
 //           | exprPrimary
-bool exprPostfix(Ret *r){
-    if(exprPrimary(r)){
+NodeId exprPostfix(Parser *p, Ret *r){
+    NodeId n = exprPrimary(p, r);
+    if(n){
         for(;;){
-            if(consume(LBRACKET)){
+            if(consume(p, LBRACKET)){
                 if(r->type.n < 0) {
-                    tkerr("only an array can be indexed");
+                    tkerr(p, "only an array can be indexed");
                 }
                 
                 Ret idx;
-                if(expr(&idx)) {
+                NodeId nIdx = expr(p, &idx);
+                if(nIdx) {
                     Type tInt = {TB_INT, NULL, -1};
                     if(!convTo(&idx.type, &tInt)) {
-                        tkerr("the index is not convertible to int");
+                        tkerr(p, "the index is not convertible to int");
                     }
                     
                     // Result is element type (remove array dimension)
                     r->type.n = -1;
                     r->lval = true;
                     r->ct = false;
+                    n = newNode2(p, N_INDEX, node(p, n)->line, n, nIdx);
+                    setRet(p, n, r);
                     
-                    if(consume(RBRACKET)){
+                    if(consume(p, RBRACKET)){
                         // continue loop - expression is recursive
                     } else {
-                        tkerr("missing ]");
+                        tkerr(p, "missing ]");
                     }
                 } else {
-                    tkerr("missing expression after [");
+                    tkerr(p, "missing expression after [");
                 }
-            } else if(consume(DOT)){
+            } else if(consume(p, DOT)){
                 if(r->type.tb != TB_STRUCT) {
-                    tkerr("a field can only be selected from a struct");
+                    tkerr(p, "a field can only be selected from a struct");
                 }
                 
-                if(consume(ID)){
-                    Token *tkName = consumedTk;
-                    Symbol *s = findSymbolInList(r->type.s->structMembers, tkName->text);
+                if(consume(p, ID)){
+                    Token *tkName = tkAt(p, p->consumedTk);
+                    Symbol *s = findStructMember(r->type.s, tkName->text);
                     
                     if(!s) {
-                        tkerr("the structure %s does not have a field %s", 
+                        tkerr(p, "the structure %s does not have a field %s", 
                                r->type.s->name, tkName->text);
                     }
                     
                     // Result is the field's type
                     *r = (Ret){s->type, true, s->type.n >= 0};
+                    n = newNode1(p, N_FIELD, node(p, n)->line, n);
+                    node(p, n)->sym = s;
+                    setRet(p, n, r);
                 } else {
-                    tkerr("missing identifier after .");
+                    tkerr(p, "missing identifier after .");
                 }
             } else {
                 break;
             }
         }
-        return true;
     }
-    return false;
+    return n;
 }
 
 // exprUnary: ( SUB | NOT ) exprUnary | exprPostfix
-bool exprUnary(Ret *r){
-    if(consume(SUB) || consume(NOT)){
-        Token *op = consumedTk;
+NodeId exprUnary(Parser *p, Ret *r){
+    if(consume(p, SUB) || consume(p, NOT)){
+        Token *op = tkAt(p, p->consumedTk);
         
-        if(exprUnary(r)){
+        NodeId a = exprUnary(p, r);
+        if(a){
             if(!canBeScalar(r)) {
-                tkerr("unary - or ! must have a scalar operand");
+                tkerr(p, "unary - or ! must have a scalar operand");
             }
             
             // For NOT operator, result is always int
@@ -275,333 +419,244 @@ bool exprUnary(Ret *r){
             
             r->lval = false;
             r->ct = true;
-            return true;
+            NodeId n = newNode1(p, op->code == NOT ? N_NOT : N_NEG, op->line, a);
+            setRet(p, n, r);
+            return n;
         }
-        tkerr("invalid unary expression");
-    }
-    if(exprPostfix(r)){
-        return true;
+        tkerr(p, "invalid unary expression");
     }
-    return false;
+    return exprPostfix(p, r);
 }
 
-// exprCast: LPAR typeBase arrayDecl? RPAR exprCast | exprUnary
-// exprCast: LPAR typeBase arrayDecl? RPAR exprCast | exprUnary
-bool exprCast(Ret *r){
-    if(consume(LPAR)){
-        Token *start = iTk;
-        Type t;
-        
-        if(typeBase(&t)){
-            arrayDecl(&t); // optional
-            
-            if(consume(RPAR)){
-                Ret op;
-                // CHANGE THIS LINE: Use exprUnary instead of recursive exprCast call
-                if(exprUnary(&op)){
-                    // Allow struct-to-struct casts of the same type
-                    if(t.tb == TB_STRUCT && op.type.tb == TB_STRUCT) {
-                        if(t.s != op.type.s) {
-                            tkerr("cannot cast between different struct types");
-                        }
-                        // Same struct type cast is allowed - don't report an error here
-                    } 
-                    // Don't allow casting between struct and non-struct
-                    else if(t.tb == TB_STRUCT) {
-                        tkerr("cannot convert to a struct type");
-                    }
-                    else if(op.type.tb == TB_STRUCT) {
-                        tkerr("cannot convert a struct");
-                    }
-                    
-                    // Array conversion validation
-                    if(op.type.n >= 0 && t.n < 0) {
-                        tkerr("an array can be converted only to another array");
-                    }
-                    if(op.type.n < 0 && t.n >= 0) {
-                        tkerr("a scalar can be converted only to another scalar");
-                    }
-                    
-                    *r = (Ret){t, false, true};
-                    return true;
+// the part of a cast after LPAR: typeBase arrayDecl? RPAR exprUnary
+// line is the line of LPAR
+NodeId castRest(Parser *p, Ret *r, int line){
+    Type t;
+    typeBase(p, &t);
+    arrayDecl(p, &t); // optional
+    
+    if(consume(p, RPAR)){
+        Ret op;
+        NodeId a = exprUnary(p, &op);
+        if(a){
+            // Allow struct-to-struct casts of the same type
+            if(t.tb == TB_STRUCT && op.type.tb == TB_STRUCT) {
+                if(t.s != op.type.s) {
+                    tkerr(p, "cannot cast between different struct types");
                 }
-                tkerr("invalid expression after cast");
+                // Same struct type cast is allowed - don't report an error here
+            } 
+            // Don't allow casting between struct and non-struct
+            else if(t.tb == TB_STRUCT) {
+                tkerr(p, "cannot convert to a struct type");
             }
-            tkerr("missing )");
-        }else{
-            // Restore position - not a cast but an expression in parentheses
-            iTk = start;
-        }
-    }
-    if(exprUnary(r)){
-        return true;
-    }
-    return false;
-}
-
-// exprMul: exprMul ( MUL | DIV ) exprCast | exprCast
-bool exprMul(Ret *r){
-    if(exprCast(r)){
-        for(;;){
-            if(consume(MUL) || consume(DIV)){
-                Ret right;
-                
-                if(exprCast(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for * or /");
-                    }
-                    
-                    *r = (Ret){tDst, false, true};
-                } else {
-                    tkerr("invalid multiplication expression");
-                }
-            } else {
-                break;
+            else if(op.type.tb == TB_STRUCT) {
+                tkerr(p, "cannot convert a struct");
             }
-        }
-        return true;
-    }
-    return false;
-}
-
-// exprAdd: exprAdd ( ADD | SUB ) exprMul | exprMul
-bool exprAdd(Ret *r){
-    if(exprMul(r)){
-        for(;;){
-            if(consume(ADD) || consume(SUB)){
-                Ret right;
-                
-                if(exprMul(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for + or -");
-                    }
-                    
-                    *r = (Ret){tDst, false, true};
-                } else {
-                    tkerr("invalid addition expression");
-                }
-            } else {
-                break;
+            
+            // Array conversion validation
+            if(op.type.n >= 0 && t.n < 0) {
+                tkerr(p, "an array can be converted only to another array");
             }
-        }
-        return true;
-    }
-    return false;
-}
-
-// exprRel: exprRel ( LESS | LESSEQ | GREATER | GREATEREQ ) exprAdd | exprAdd
-bool exprRel(Ret *r){
-    if(exprAdd(r)){
-        for(;;){
-            if(consume(LESS) || consume(LESSEQ) || consume(GREATER) || consume(GREATEREQ)){
-                Ret right;
-                
-                if(exprAdd(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for <, <=, >, >=");
-                    }
-                    
-                    // Result is always an int (boolean)
-                    *r = (Ret){{TB_INT, NULL, -1}, false, true};
-                } else {
-                    tkerr("invalid relational expression");
-                }
-            } else {
-                break;
+            if(op.type.n < 0 && t.n >= 0) {
+                tkerr(p, "a scalar can be converted only to another scalar");
             }
+            
+            *r = (Ret){t, false, true};
+            NodeId n = newNode1(p, N_CAST, line, a);
+            setRet(p, n, r);
+            return n;
         }
-        return true;
+        tkerr(p, "invalid expression after cast");
     }
-    return false;
+    tkerr(p, "missing )");
+    return 0;
 }
 
-// exprEq: exprEq ( EQUAL | NOTEQ ) exprRel | exprRel
-bool exprEq(Ret *r){
-    if(exprRel(r)){
-        for(;;){
-            if(consume(EQUAL) || consume(NOTEQ)){
-                Ret right;
-                
-                if(exprRel(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for == or !=");
-                    }
-                    
-                    // Result is always an int (boolean)
-                    *r = (Ret){{TB_INT, NULL, -1}, false, true};
-                } else {
-                    tkerr("invalid equality expression");
-                }
-            } else {
-                break;
-            }
-        }
-        return true;
+// exprCast: LPAR typeBase arrayDecl? RPAR exprUnary | exprUnary
+// a LPAR followed by a type starts a cast, else it is left to exprPrimary
+NodeId exprCast(Parser *p, Ret *r){
+    if(peek(p, 0) == LPAR && isTypeStart(peek(p, 1))){
+        consume(p, LPAR);
+        return castRest(p, r, tkAt(p, p->consumedTk)->line);
     }
-    return false;
+    return exprUnary(p, r);
 }
 
+// The binary operators are parsed by precedence climbing, with the operators from binOps:
+// expr: exprAssign
+// exprAssign: exprUnary ASSIGN exprAssign | exprOr
+// exprOr: exprOr OR exprAnd | exprAnd
 // exprAnd: exprAnd AND exprEq | exprEq
-bool exprAnd(Ret *r){
-    if(exprEq(r)){
-        for(;;){
-            if(consume(AND)){
-                Ret right;
-                
-                if(exprEq(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for &&");
-                    }
-                    
-                    // Result is always an int (boolean)
-                    *r = (Ret){{TB_INT, NULL, -1}, false, true};
-                } else {
-                    tkerr("invalid AND expression");
-                }
-            } else {
-                break;
-            }
-        }
-        return true;
-    }
-    return false;
-}
+// exprEq: exprEq ( EQUAL | NOTEQ ) exprRel | exprRel
+// exprRel: exprRel ( LESS | LESSEQ | GREATER | GREATEREQ ) exprAdd | exprAdd
+// exprAdd: exprAdd ( ADD | SUB ) exprMul | exprMul
+// exprMul: exprMul ( MUL | DIV ) exprCast | exprCast
 
-// exprOr: exprOr OR exprAnd | exprAnd
-bool exprOr(Ret *r){
-    if(exprAnd(r)){
-        for(;;){
-            if(consume(OR)){
-                Ret right;
-                
-                if(exprAnd(&right)){
-                    Type tDst;
-                    if(!arithTypeTo(&r->type, &right.type, &tDst)) {
-                        tkerr("invalid operand type for ||");
-                    }
-                    
-                    // Result is always an int (boolean)
-                    *r = (Ret){{TB_INT, NULL, -1}, false, true};
-                } else {
-                    tkerr("invalid OR expression");
-                }
-            } else {
-                break;
-            }
-        }
-        return true;
+// the checks of the binary operators
+enum{
+    OP_ARITH,       // arithmetic operands, the result has their arithTypeTo type
+    OP_LOGIC,       // arithmetic operands, the result is int
+    OP_ASSIGN       // the checks of exprAssign
+};
+
+typedef struct{
+    NodeKind kind;          // the kind of the operator's node
+    int prec;               // the precedence (bigger - binds stronger), 0 if the token is not a binary operator
+    bool rightAssoc;
+    int check;              // OP_*
+    const char *typeErr;    // the error for invalid operand types
+    const char *rightErr;   // the error for a missing right operand
+}BinOp;
+
+#define PREC_ASSIGN 1
+
+static const BinOp binOps[STRING + 1] = {
+    [ASSIGN] = {N_ASSIGN, PREC_ASSIGN, true, OP_ASSIGN, NULL, "invalid assignment expression"},
+    [OR] = {N_OR, 2, false, OP_LOGIC, "invalid operand type for ||", "invalid OR expression"},
+    [AND] = {N_AND, 3, false, OP_LOGIC, "invalid operand type for &&", "invalid AND expression"},
+    [EQUAL] = {N_EQUAL, 4, false, OP_LOGIC, "invalid operand type for == or !=", "invalid equality expression"},
+    [NOTEQ] = {N_NOTEQ, 4, false, OP_LOGIC, "invalid operand type for == or !=", "invalid equality expression"},
+    [LESS] = {N_LESS, 5, false, OP_LOGIC, "invalid operand type for <, <=, >, >=", "invalid relational expression"},
+    [LESSEQ] = {N_LESSEQ, 5, false, OP_LOGIC, "invalid operand type for <, <=, >, >=", "invalid relational expression"},
+    [GREATER] = {N_GREATER, 5, false, OP_LOGIC, "invalid operand type for <, <=, >, >=", "invalid relational expression"},
+    [GREATEREQ] = {N_GREATEREQ, 5, false, OP_LOGIC, "invalid operand type for <, <=, >, >=", "invalid relational expression"},
+    [ADD] = {N_ADD, 6, false, OP_ARITH, "invalid operand type for + or -", "invalid addition expression"},
+    [SUB] = {N_SUB, 6, false, OP_ARITH, "invalid operand type for + or -", "invalid addition expression"},
+    [MUL] = {N_MUL, 7, false, OP_ARITH, "invalid operand type for * or /", "invalid multiplication expression"},
+    [DIV] = {N_DIV, 7, false, OP_ARITH, "invalid operand type for * or /", "invalid multiplication expression"}
+};
+
+// checks an assignment of the source r to the destination rDst and sets r with its result
+void checkAssign(Parser *p, Ret *r, Ret *rDst){
+    // Check if destination is a valid lvalue
+    if(!rDst->lval) {
+        tkerr(p, "the assign destination must be a left-value");
     }
-    return false;
+    if(rDst->ct) {
+        tkerr(p, "the assign destination cannot be constant");
+    }
+    
+    // Check if both operands are scalar
+    if(!canBeScalar(rDst)) {
+        tkerr(p, "the assign destination must be scalar");
+    }
+    if(!canBeScalar(r)) {
+        tkerr(p, "the assign source must be scalar");
+    }
+    
+    // Check type compatibility
+    if(!convTo(&r->type, &rDst->type)) {
+        tkerr(p, "the assign source cannot be converted to destination");
+    }
+    
+    // Assignment result is the destination type
+    r->type = rDst->type;
+    r->lval = false;
+    r->ct = false;
 }
 
-// exprAssign: exprUnary ASSIGN exprAssign | exprOr
-bool exprAssign(Ret *r){
-    Token *startTk = iTk;
-    Ret rDst;
-    
-    if(exprUnary(&rDst)){
-        if(consume(ASSIGN)){
-            if(exprAssign(r)){
-                // Check if destination is a valid lvalue
-                if(!rDst.lval) {
-                    tkerr("the assign destination must be a left-value");
-                }
-                if(rDst.ct) {
-                    tkerr("the assign destination cannot be constant");
-                }
-                
-                // Check if both operands are scalar
-                if(!canBeScalar(&rDst)) {
-                    tkerr("the assign destination must be scalar");
-                }
-                if(!canBeScalar(r)) {
-                    tkerr("the assign source must be scalar");
+// parses an expression which has only operators with a precedence of at least minPrec
+// an assignment is valid only if its destination is an exprCast, so not after another operator
+NodeId exprPrec(Parser *p, Ret *r, int minPrec){
+    NodeId n = exprCast(p, r);
+    if(!n){
+        return 0;
+    }
+    bool single = true;     // r is a single exprCast
+    for(;;){
+        int code = peek(p, 0);
+        const BinOp *op = &binOps[code];
+        if(op->prec < minPrec || (op->check == OP_ASSIGN && !single)){
+            return n;
+        }
+        consume(p, code);
+        Ret right;
+        NodeId nRight = exprPrec(p, &right, op->rightAssoc ? op->prec : op->prec + 1);
+        if(!nRight){
+            tkerr(p, "%s", op->rightErr);
+        }
+        Type tDst;
+        switch(op->check){
+            case OP_ASSIGN:
+                checkAssign(p, &right, r);
+                *r = right;
+                break;
+            case OP_ARITH:
+                if(!arithTypeTo(&r->type, &right.type, &tDst)) {
+                    tkerr(p, "%s", op->typeErr);
                 }
-                
-                // Check type compatibility
-                if(!convTo(&r->type, &rDst.type)) {
-                    tkerr("the assign source cannot be converted to destination");
+                *r = (Ret){tDst, false, true};
+                break;
+            default:    // OP_LOGIC
+                if(!arithTypeTo(&r->type, &right.type, &tDst)) {
+                    tkerr(p, "%s", op->typeErr);
                 }
-                
-                // Assignment result is the destination type
-                r->type = rDst.type;
-                r->lval = false;
-                r->ct = false;
-                return true;
-            }
-            tkerr("invalid assignment expression");
-        } else {
-            // Not an assignment, restore position and try exprOr
-            iTk = startTk;
+                // Result is always an int (boolean)
+                *r = (Ret){{TB_INT, NULL, -1}, false, true};
         }
+        n = newNode2(p, op->kind, node(p, n)->line, n, nRight);
+        setRet(p, n, r);
+        single = false;
     }
-    if(exprOr(r)){
-        return true;
-    }
-    return false;
 }
 
-// expr: exprAssign
-bool expr(Ret *r){
-    if(exprAssign(r)){
-        return true;
-    }
-    return false;
+NodeId expr(Parser *p, Ret *r){
+    return exprPrec(p, r, PREC_ASSIGN);
 }
 
 // exprPrimary: ID ( LPAR ( expr ( COMMA expr )* )? RPAR )?
 //            | INT | DOUBLE | CHAR | STRING | LPAR expr RPAR
-bool exprPrimary(Ret *r){
-    if(consume(ID)){
-        Token *tkName = consumedTk;
-        Symbol *s = findSymbol(tkName->text);
+NodeId exprPrimary(Parser *p, Ret *r){
+    if(consume(p, ID)){
+        Token *tkName = tkAt(p, p->consumedTk);
+        Symbol *s = findVisible(p, tkName->text);
         
         if(!s) {
-            tkerr("undefined id: %s", tkName->text);
+            tkerr(p, "undefined id: %s", tkName->text);
         }
         
-        if(consume(LPAR)){
+        if(consume(p, LPAR)){
             // Function call
             if(s->kind != SK_FN) {
-                tkerr("only a function can be called");
+                tkerr(p, "only a function can be called");
             }
             
             // Check function arguments
             Ret rArg;
             Symbol *param = s->fn.params;
+            NodeId n = astNew(&p->ast, N_CALL, tkName->line), last = 0, arg;
+            node(p, n)->sym = s;
             
-            if(expr(&rArg)){
+            if((arg = expr(p, &rArg))){
                 if(!param) {
-                    tkerr("too many arguments in function call");
+                    tkerr(p, "too many arguments in function call");
                 }
                 
                 // Check parameter type compatibility
                 if(!convTo(&rArg.type, &param->type)) {
-                    tkerr("in call, cannot convert the argument type to the parameter type");
+                    tkerr(p, "in call, cannot convert the argument type to the parameter type");
                 }
                 
                 param = param->next;
+                astAppend(&p->ast, n, &last, arg);
                 
                 for(;;){
-                    if(consume(COMMA)){
+                    if(consume(p, COMMA)){
                         if(!param) {
-                            tkerr("too many arguments in function call");
+                            tkerr(p, "too many arguments in function call");
                         }
                         
-                        if(expr(&rArg)){
+                        if((arg = expr(p, &rArg))){
                             // Check parameter type compatibility
                             if(!convTo(&rArg.type, &param->type)) {
-                                tkerr("in call, cannot convert the argument type to the parameter type");
+                                tkerr(p, "in call, cannot convert the argument type to the parameter type");
                             }
                             
                             param = param->next;
+                            astAppend(&p->ast, n, &last, arg);
                         } else {
-                            tkerr("invalid expression after ,");
+                            tkerr(p, "invalid expression after ,");
                         }
                     } else {
                         break;
@@ -610,126 +665,107 @@ bool exprPrimary(Ret *r){
             }
             
             if(param) {
-                tkerr("too few arguments in function call");
+                tkerr(p, "too few arguments in function call");
             }
             
-            if(consume(RPAR)){
+            if(consume(p, RPAR)){
                 // Result is the function's return type
                 *r = (Ret){s->type, false, true};
-                return true;
+                setRet(p, n, r);
+                return n;
             }
-            tkerr("missing ) in function call");
+            tkerr(p, "missing ) in function call");
         } else {
             // Variable reference
             if(s->kind == SK_FN) {
-                tkerr("a function can only be called");
+                tkerr(p, "a function can only be called");
             }
             
             // Result is the variable's type
             *r = (Ret){s->type, true, s->type.n >= 0};
-            return true;
+            NodeId n = astNew(&p->ast, N_ID, tkName->line);
+            node(p, n)->sym = s;
+            setRet(p, n, r);
+            return n;
         }
     }
     
-    if(consume(INT)){
+    NodeId n;
+    if(consume(p, INT)){
         *r = (Ret){{TB_INT, NULL, -1}, false, true};
-        return true;
+        Token *tk = tkAt(p, p->consumedTk);
+        n = astNew(&p->ast, N_INT, tk->line);
+        node(p, n)->i = tk->i;
+        setRet(p, n, r);
+        return n;
     }
     
-    if(consume(DOUBLE)){
+    if(consume(p, DOUBLE)){
         *r = (Ret){{TB_DOUBLE, NULL, -1}, false, true};
-        return true;
+        Token *tk = tkAt(p, p->consumedTk);
+        n = astNew(&p->ast, N_DOUBLE, tk->line);
+        node(p, n)->d = tk->d;
+        setRet(p, n, r);
+        return n;
     }
     
-    if(consume(CHAR)){
+    if(consume(p, CHAR)){
         *r = (Ret){{TB_CHAR, NULL, -1}, false, true};
-        return true;
+        Token *tk = tkAt(p, p->consumedTk);
+        n = astNew(&p->ast, N_CHAR, tk->line);
+        node(p, n)->c = tk->c;
+        setRet(p, n, r);
+        return n;
     }
     
-    if(consume(STRING)){
+    if(consume(p, STRING)){
         *r = (Ret){{TB_CHAR, NULL, 0}, false, true};
-        return true;
+        Token *tk = tkAt(p, p->consumedTk);
+        n = astNew(&p->ast, N_STRING, tk->line);
+        node(p, n)->text = tkString(&p->texts, p->src, tk);
+        setRet(p, n, r);
+        return n;
     }
     
-    if(consume(LPAR)){
-        // First, check if this could be a cast by peeking ahead
-        Token *savedTk = iTk;
-        
-        // Try to parse as a type
-        Type t;
-        //bool isCast = false;
-        
-        if(typeBase(&t)){
-            arrayDecl(&t); // optional
-            if(consume(RPAR)){
-                // It's a cast expression
-                Ret op;
-                if(exprUnary(&op)){
-                    // Handle the cast
-                    // Allow struct-to-struct casts of the same type
-                    if(t.tb == TB_STRUCT && op.type.tb == TB_STRUCT) {
-                        if(t.s != op.type.s) {
-                            tkerr("cannot cast between different struct types");
-                        }
-                        // Same struct type cast is allowed
-                    } 
-                    else if(t.tb == TB_STRUCT) {
-                        tkerr("cannot convert to a struct type");
-                    }
-                    else if(op.type.tb == TB_STRUCT) {
-                        tkerr("cannot convert a struct");
-                    }
-                    
-                    // Array conversion validation
-                    if(op.type.n >= 0 && t.n < 0) {
-                        tkerr("an array can be converted only to another array");
-                    }
-                    if(op.type.n < 0 && t.n >= 0) {
-                        tkerr("a scalar can be converted only to another scalar");
-                    }
-                    
-                    *r = (Ret){t, false, true};
-                    return true;
-                }
-                tkerr("invalid expression after cast");
-            }
+    if(consume(p, LPAR)){
+        // a cast as the operand of an unary operator
+        if(isTypeStart(peek(p, 0))){
+            return castRest(p, r, tkAt(p, p->consumedTk)->line);
         }
         
-        // Restore position - not a cast, try as normal parenthesized expression
-        iTk = savedTk;
-        
-        if(expr(r)){
-            if(consume(RPAR)){
-                return true;
+        if((n = expr(p, r))){
+            if(consume(p, RPAR)){
+                return n;
             }
-            tkerr("missing ) in expression");
+            tkerr(p, "missing ) in expression");
         }
-        tkerr("invalid expression after (");
+        tkerr(p, "invalid expression after (");
     }
-    return false;
+    return 0;
 }
 
 // Forward declaration
-bool stm();
+NodeId stm(Parser *p);
 
 // stmCompound: LACC ( varDef | stm )* RACC
-bool stmCompound(bool newDomain){
-    if(consume(LACC)){
-        if(newDomain) pushDomain();
+NodeId stmCompound(Parser *p, bool newDomain){
+    if(consume(p, LACC)){
+        if(newDomain) pushDomain(p->st);
+        NodeId n = astNew(&p->ast, N_BLOCK, tkAt(p, p->consumedTk)->line), last = 0, item;
         
         for(;;){
-            if(varDef()){}
-            else if(stm()){}
-            else break;
+            if(isVarDefStart(p)) item = varDef(p);
+            else if(!(item = stm(p))) break;
+            astAppend(&p->ast, n, &last, item);
         }
         
-        if(consume(RACC)){
-            if(newDomain) dropDomain();
-            return true;
+        if(consume(p, RACC)){
+            if(newDomain) dropDomain(p->st);
+            return n;
         }
-        tkerr("missing } in compound statement");
+        tkerr(p, "missing } in compound statement");
     }
-    return false;
+    return 0;
 }
 
 // stm: stmCompound
@@ -737,164 +773,215 @@ bool stmCompound(bool newDomain){
 //    | WHILE LPAR expr RPAR stm
 //    | RETURN expr? SEMICOLON
 //    | expr? SEMICOLON
-bool stm(){
+NodeId stm(Parser *p){
     Ret rCond, rExpr;
+    NodeId n, nCond, nStm;
     
-    if(stmCompound(true)){
-        return true;
+    if((n = stmCompound(p, true))){
+        return n;
     }
-    if(consume(IF)){
-        if(consume(LPAR)){
-            if(expr(&rCond)){
+    if(consume(p, IF)){
+        n = astNew(&p->ast, N_IF, tkAt(p, p->consumedTk)->line);
+        if(consume(p, LPAR)){
+            if((nCond = expr(p, &rCond))){
                 // Check if condition is scalar
                 if(!canBeScalar(&rCond)) {
-                    tkerr("the if condition must be a scalar value");
+                    tkerr(p, "the if condition must be a scalar value");
                 }
                 
-                if(consume(RPAR)){
-                    if(stm()){
-                        if(consume(ELSE)){
-                            if(stm()){
-                                return true;
+                if(consume(p, RPAR)){
+                    if((nStm = stm(p))){
+                        node(p, n)->first = nCond;
+                        node(p, nCond)->next = nStm;
+                        if(consume(p, ELSE)){
+                            NodeId nElse = stm(p);
+                            if(nElse){
+                                node(p, nStm)->next = nElse;
+                                return n;
                             }
-                            tkerr("missing statement after else");
+                            tkerr(p, "missing statement after else");
                         }
-                        return true;
+                        return n;
                     }
-                    tkerr("missing statement after if");
+                    tkerr(p, "missing statement after if");
                 }
-                tkerr("missing )");
+                tkerr(p, "missing )");
             }
-            tkerr("missing expression after (");
+            tkerr(p, "missing expression after (");
         }
-        tkerr("missing (");
+        tkerr(p, "missing (");
     }
-    if(consume(WHILE)){
-        if(consume(LPAR)){
-            if(expr(&rCond)){
+    if(consume(p, WHILE)){
+        int line = tkAt(p, p->consumedTk)->line;
+        if(consume(p, LPAR)){
+            if((nCond = expr(p, &rCond))){
                 // Check if condition is scalar
                 if(!canBeScalar(&rCond)) {
-                    tkerr("the while condition must be a scalar value");
+                    tkerr(p, "the while condition must be a scalar value");
                 }
                 
-                if(consume(RPAR)){
-                    if(stm()){
-                        return true;
+                if(consume(p, RPAR)){
+                    if((nStm = stm(p))){
+                        return newNode2(p, N_WHILE, line, nCond, nStm);
                     }
-                    tkerr("missing statement after while");
+                    tkerr(p, "missing statement after while");
                 }
-                tkerr("missing )");
+                tkerr(p, "missing )");
             }
-            tkerr("missing expression after (");
+            tkerr(p, "missing expression after (");
         }
-        tkerr("missing (");
+        tkerr(p, "missing (");
     }
-    if(consume(RETURN)){
+    if(consume(p, RETURN)){
+        n = astNew(&p->ast, N_RETURN, tkAt(p, p->consumedTk)->line);
         // Validate return statement
-        if(expr(&rExpr)){ 
+        NodeId nExpr = expr(p, &rExpr);
+        if(nExpr){ 
             // Check return value against function return type
-            if(owner->type.tb == TB_VOID) {
-                tkerr("a void function cannot return a value");
+            if(p->owner->type.tb == TB_VOID) {
+                tkerr(p, "a void function cannot return a value");
             }
             
             if(!canBeScalar(&rExpr)) {
-                tkerr("the return value must be a scalar value");
+                tkerr(p, "the return value must be a scalar value");
             }
             
-            if(!convTo(&rExpr.type, &owner->type)) {
-                tkerr("cannot convert the return expression type to the function return type");
+            if(!convTo(&rExpr.type, &p->owner->type)) {
+                tkerr(p, "cannot convert the return expression type to the function return type");
             }
+            node(p, n)->first = nExpr;
         } else {
             // No return value provided
-            if(owner->type.tb != TB_VOID) {
-                tkerr("a non-void function must return a value");
+            if(p->owner->type.tb != TB_VOID) {
+                tkerr(p, "a non-void function must return a value");
             }
         }
         
-        if(consume(SEMICOLON)){
-            return true;
+        if(consume(p, SEMICOLON)){
+            return n;
         }
-        tkerr("missing ;");
-    }
-    Token *start = iTk;
-    if(expr(&rExpr)){ 
-        // Expression statement
+        tkerr(p, "missing ;");
     }
-    if(consume(SEMICOLON)){
-        return true;
+    int start = p->iTk, line = tkAt(p, p->iTk)->line;
+    // Expression statement
+    NodeId nExpr = expr(p, &rExpr);
+    if(consume(p, SEMICOLON)){
+        return newNode1(p, N_EXPR, line, nExpr);
     }
-    if(iTk != start){
-        tkerr("missing ;");
+    if(p->iTk != start){
+        tkerr(p, "missing ;");
     }
-    return false;
+    return 0;
 }
 
 // fnParam: typeBase ID arrayDecl?
-bool fnParam(){
+NodeId fnParam(Parser *p){
     Type t;
     Token *tkName;
+    int line = tkAt(p, p->iTk)->line;
     
-    if(typeBase(&t)){
-        if(consume(ID)){
-            tkName = consumedTk;
+    if(typeBase(p, &t)){
+        if(consume(p, ID)){
+            tkName = tkAt(p, p->consumedTk);
             
-            if(arrayDecl(&t)) {
+            if(arrayDecl(p, &t)) {
                 t.n = 0; // Reset dimension for array parameters
             }
             
             // Check for parameter redefinition
-            Symbol *param = findSymbolInDomain(symTable, tkName->text);
-            if(param) tkerr("symbol redefinition: %s", tkName->text);
+            Symbol *param = findSymbolInDomain(p->st, tkName->text);
+            if(param) tkerr(p, "symbol redefinition: %s", tkName->text);
             
             // Create parameter symbol
-            param = newSymbol(tkName->text, SK_PARAM);
+            param = newOwnedSymbol(p, tkName->text, SK_PARAM);
             param->type = t;
-            param->owner = owner;
-            param->paramIdx = symbolsLen(owner->fn.params);
+            param->paramIdx = symbolsLen(p->owner->fn.params);
             
             // Add parameter to domain and function
-            addSymbolToDomain(symTable, param);
-            addSymbolToList(&owner->fn.params, dupSymbol(param));
+            addSymbolToDomain(p->st, param);
+            addSymbolToList(&p->owner->fn.params, param);
             
-            return true;
+            NodeId n = astNew(&p->ast, N_PARAM, line);
+            node(p, n)->sym = param;
+            astSetType(&p->ast, n, &t);
+            return n;
         }
-        tkerr("missing parameter identifier");
+        tkerr(p, "missing parameter identifier");
     }
-    return false;
+    return 0;
+}
+
+// a function body of a parallel parse
+typedef struct FnBody {
+    Symbol *fn;
+    Domain *domain;        // the function's domain, with its parameters, removed from the domains stack
+    NodeId node;           // the N_FN node
+    NodeId lastParam;      // the last child of node
+    int tkBody;            // the index of the body's LACC in p->tkArray
+    // the result of the analysis: the body's nodes are [from,to) from the AST of the worker
+    int worker;
+    NodeId root, from, to;
+} FnBody;
+
+// records the body which starts at the current token and returns the index of its RACC (or of END if it has none)
+// the braces of a correct body are balanced, so its end is found without parsing it
+static int deferBody(Parser *p, Symbol *fn, NodeId n, NodeId last){
+    if(p->nBodies == p->bodiesCap){
+        p->bodiesCap = p->bodiesCap ? p->bodiesCap * 2 : 64;
+        p->bodies = safeRealloc(p->bodies, p->bodiesCap * sizeof(FnBody));
+    }
+    FnBody *b = &p->bodies[p->nBodies++];
+    b->fn = fn;
+    b->domain = detachDomain(p->st);
+    b->node = n;
+    b->lastParam = last;
+    b->tkBody = p->iTk;
+    int depth = 0, i = p->iTk;
+    for(;; i++){
+        int code = p->tkArray[i].code;
+        if(code == LACC) depth++;
+        else if((code == RACC && --depth == 0) || code == END) break;
+    }
+    return i;
 }
 
 // fnDef: ( typeBase | VOID ) ID LPAR ( fnParam ( COMMA fnParam )* )? RPAR stmCompound
-bool fnDef(){
-    Token *start = iTk;
+// it is called only if the current tokens are ( typeBase | VOID ) ID LPAR
+NodeId fnDef(Parser *p){
     Type t;
     Token *tkName;
+    int line = tkAt(p, p->iTk)->line;
     
-    if(typeBase(&t) || (consume(VOID) && (t.tb = TB_VOID, true))){
-        if(consume(ID)){
-            tkName = consumedTk;
+    if(typeBase(p, &t) || (consume(p, VOID) && (t.tb = TB_VOID, true))){
+        if(consume(p, ID)){
+            tkName = tkAt(p, p->consumedTk);
             
-            if(consume(LPAR)){
+            if(consume(p, LPAR)){
                 // Check for function redefinition
-                Symbol *fn = findSymbolInDomain(symTable, tkName->text);
-                if(fn) tkerr("symbol redefinition: %s", tkName->text);
+                Symbol *fn = findSymbolInDomain(p->st, tkName->text);
+                if(fn) tkerr(p, "symbol redefinition: %s", tkName->text);
                 
                 // Create function symbol
-                fn = newSymbol(tkName->text, SK_FN);
+                fn = newSymbol(p->st, tkName->text, SK_FN);
                 fn->type = t;
-                addSymbolToDomain(symTable, fn);
+                addSymbolToDomain(p->st, fn);
+                NodeId n = astNew(&p->ast, N_FN, line), last = 0, item;
+                node(p, n)->sym = fn;
+                astSetType(&p->ast, n, &t);
                 
                 // Set owner and create function domain
-                owner = fn;
-                pushDomain();
+                p->owner = fn;
+                pushDomain(p->st);
                 
                 // Parse parameters
-                if(fnParam()){
+                if((item = fnParam(p))){
+                    astAppend(&p->ast, n, &last, item);
                     for(;;){
-                        if(consume(COMMA)){
-                            if(fnParam()){
-                                // continue loop
+                        if(consume(p, COMMA)){
+                            if((item = fnParam(p))){
+                                astAppend(&p->ast, n, &last, item);
                             }else{
-                                tkerr("invalid parameter after ,");
+                                tkerr(p, "invalid parameter after ,");
                             }
                         }else{
                             break;
@@ -902,48 +989,243 @@ bool fnDef(){
                     }
                 }
                 
-                if(consume(RPAR)){
-                    if(stmCompound(false)){ // Don't create a new domain
+                if(consume(p, RPAR)){
+                    if(p->pool && p->tkArray && tkAt(p, p->iTk)->code == LACC){
+                        // the body is analysed later, after the rest of the unit
+                        int end = deferBody(p, fn, n, last);
+                        tkStartAt(p, end);
+                        if(!consume(p, RACC)) tkerr(p, "missing } in compound statement");
+                        p->owner = NULL;
+                        return n;
+                    }
+                    if((item = stmCompound(p, false))){ // Don't create a new domain
+                        astAppend(&p->ast, n, &last, item);
                         // Cleanup after function
-                        dropDomain();
-                        owner = NULL;
-                        return true;
+                        dropDomain(p->st);
+                        p->owner = NULL;
+                        return n;
                     }
-                    tkerr("missing function body");
+                    tkerr(p, "missing function body");
                 }
-                tkerr("missing )");
-            } else {
-                // Not a function, restore position
-                iTk = start;
-                return false;
+                tkerr(p, "missing )");
             }
+            tkerr(p, "missing ( after function name");
         }
-        // Restore position
-        iTk = start;
+        tkerr(p, "missing function name");
     }
-    return false;
+    return 0;
 }
 
 // unit: ( structDef | fnDef | varDef )* END
-bool unit(){
+// the item is chosen by looking ahead: STRUCT ID LACC, ( typeBase | VOID ) ID LPAR or typeBase ID
+bool unit(Parser *p){
+    NodeId last = 0, item;
+    p->ast.root = astNew(&p->ast, N_UNIT, tkAt(p, p->iTk)->line);
     for(;;){
-        if(structDef()){}
-        else if(fnDef()){}
-        else if(varDef()){}
+        if(peek(p, 0) == STRUCT && peek(p, 1) == ID && peek(p, 2) == LACC) item = structDef(p);
+        else if(peek(p, 0) == VOID || (isTypeStart(peek(p, 0)) && peek(p, typeBaseLen(p)) == ID && peek(p, typeBaseLen(p) + 1) == LPAR)) item = fnDef(p);
+        else if(isVarDefStart(p)) item = varDef(p);
         else break;
+        astAppend(&p->ast, p->ast.root, &last, item);
+        // there is no backtracking before a parsed item
+        p->tkFirst = p->iTk;
     }
-    if(consume(END)){
+    if(consume(p, END)){
         return true;
     }
-    tkerr("unexpected token at end of file");
+    tkerr(p, "unexpected token at end of file");
     return false;
 }
 
-void parse(Token *tokens){
+void parserInit(Parser *p, SymTable *st, InternPool *names){
+    memset(p, 0, sizeof(Parser));
+    p->st = st;
+    p->names = names;
+}
+
+void parserFree(Parser *p){
+    for(int i = 0; i < p->tkRingSize; i++) free(p->tkRing[i]);
+    free(p->tkRing);
+    free(p->bodies);
+    arenaFree(&p->lasting);
+    astFree(&p->ast);
+    arenaFree(&p->texts);
+}
+
+// the workers which analyse the function bodies of a parallel parse
+typedef struct {
+    Parser *p;
+    Parser *workers;
+    SymTable *tables;
+    int *errBodies;        // for each worker, the body with an error, or nBodies
+    atomic_int next;       // the next body to analyse
+    atomic_int errBody;    // the first body with an error found so far, or nBodies
+} BodiesJob;
+
+// analyses the body b on the parser w, whose symbols table is st; on error, returns false with the message in w->errMsg
+static bool analyseBody(Parser *w, SymTable *st, FnBody *b){
+    attachDomain(st, b->domain);
+    w->owner = b->fn;
+    w->nVisible = b->fn->defIdx + 1;
+    tkStartAt(w, b->tkBody);
+    if(w->ast.n == 0) w->ast.n = 1;
+    b->from = w->ast.n;
+    ErrHandler h;
+    errPush(&h);
+    if(setjmp(h.env)){
+        while(st->top != b->domain) dropDomain(st);
+        detachDomain(st);
+        strcpy(w->errMsg, h.msg);
+        return false;
+    }
+    b->root = stmCompound(w, false);
+    errPop(&h);
+    detachDomain(st);
+    b->to = w->ast.n;
+    return true;
+}
+
+static void bodiesWorker(void *arg, int iWorker){
+    BodiesJob *job = (BodiesJob *)arg;
+    Parser *w = &job->workers[iWorker];
+    for(;;){
+        int i = atomic_fetch_add(&job->next, 1);
+        // the bodies after an error do not matter
+        if(i >= atomic_load(&job->errBody)) break;
+        job->p->bodies[i].worker = iWorker;
+        if(!analyseBody(w, &job->tables[iWorker], &job->p->bodies[i])){
+            job->errBodies[iWorker] = i;
+            int first = atomic_load(&job->errBody);
+            while(i < first && !atomic_compare_exchange_weak(&job->errBody, &first, i)){}
+            // the next bodies of this worker would be after i
+            break;
+        }
+    }
+}
+
+// analyses the deferred function bodies on p->pool and adds them to the AST
+// if a body has an error, returns false with the message of the first such body in p->errMsg
+static bool analyseBodies(Parser *p){
+    // the detached domains still link to the unit's domain, which is not the top one after an error
+    Domain *unit = p->bodies[0].domain->parent;
+    int nWorkers = poolThreads(p->pool);
+    if(nWorkers > p->nBodies) nWorkers = p->nBodies;
+    BodiesJob job = {p, safeAlloc(nWorkers * sizeof(Parser)), safeAlloc(nWorkers * sizeof(SymTable)),
+        safeAlloc(nWorkers * sizeof(int))};
+    atomic_init(&job.next, 0);
+    atomic_init(&job.errBody, p->nBodies);
+    for(int i = 0; i < nWorkers; i++){
+        symTableInit(&job.tables[i], p->st);
+        parserInit(&job.workers[i], &job.tables[i], p->names);
+        job.workers[i].unitDomain = unit;
+        job.workers[i].src = p->src;
+        job.workers[i].tkArray = p->tkArray;
+        job.errBodies[i] = p->nBodies;
+    }
+    poolFor(p->pool, nWorkers, bodiesWorker, &job);
+
+    int errBody = atomic_load(&job.errBody);
+    if(errBody < p->nBodies){
+        for(int i = 0; i < nWorkers; i++){
+            if(job.errBodies[i] == errBody) strcpy(p->errMsg, job.workers[i].errMsg);
+        }
+    }else{
+        for(int i = 0; i < p->nBodies; i++){
+            FnBody *b = &p->bodies[i];
+            Parser *w = &job.workers[b->worker];
+            int delta = astCopy(&p->ast, &w->ast, b->from, b->to);
+            // the texts of the strings are moved from the worker's arena
+            for(NodeId n = b->from + delta; n < b->to + delta; n++){
+                Node *nd = node(p, n);
+                if(nd->kind == N_STRING) nd->text = arenaStrdup(&p->texts, nd->text, nd->text + strlen(nd->text));
+            }
+            astAppend(&p->ast, b->node, &b->lastParam, b->root + delta);
+        }
+    }
+    for(int i = 0; i < nWorkers; i++){
+        p->nBacktracks += job.workers[i].nBacktracks;
+        arenaMerge(&unit->lasting, &job.workers[i].lasting);
+        parserFree(&job.workers[i]);
+        symTableFree(&job.tables[i]);
+    }
+    free(job.workers);
+    free(job.tables);
+    free(job.errBodies);
+    return errBody == p->nBodies;
+}
+
+// frees the domains of the deferred function bodies
+static void dropBodies(Parser *p){
+    for(int i = 0; i < p->nBodies; i++){
+        freeDomain(p->bodies[i].domain);
+    }
+    p->nBodies = 0;
+}
+
+// parses the tokens from p->tkArray or, if it is NULL, the tokens lexed on demand from p->src
+static bool parseTokens(Parser *p, bool lexThread){
+    Domain *top = p->st->top;
+    ErrHandler h;
+    errPush(&h);
+    if(setjmp(h.env)){
+        strcpy(p->errMsg, h.msg);
+        // a function body before the error can have an earlier error
+        // the domains opened after the unit's one (ex: of a function's parameters) are dropped first,
+        // so the bodies do not see their symbols
+        if(p->nBodies){
+            while(p->st->top != p->bodies[0].domain->parent) dropDomain(p->st);
+            analyseBodies(p);
+        }
+        dropBodies(p);
+        // the error can be in any domain of the unit
+        while(p->st->top != top) dropDomain(p->st);
+        astClear(&p->ast);
+        if(p->stream){
+            lexEnd(p->stream);
+            p->stream = NULL;
+        }
+        return false;
+    }
+    if(!p->tkArray) p->stream = lexThread ? lexBeginThread(p->names, p->src) : lexBegin(p->names, p->src);
+
     // Initialize domain analysis
-    pushDomain(); // Global domain
-    owner = NULL;
+    pushDomain(p->st); // Global domain
+    p->owner = NULL;
     
-    iTk = tokens;
-    if(!unit()) tkerr("syntax error");
-}
\ No newline at end of file
+    p->iTk = 0;
+    p->tkFirst = p->tkPulled = 0;
+    p->maxConsumedTk = -1;
+    p->nBacktracks = 0;
+    astClear(&p->ast);
+    arenaFree(&p->texts);
+    p->nBodies = 0;
+    if(!unit(p)) tkerr(p, "syntax error");
+    if(p->stream){
+        lexEnd(p->stream);
+        p->stream = NULL;
+    }
+    errPop(&h);
+    if(p->nBodies){
+        bool ok = analyseBodies(p);
+        dropBodies(p);
+        if(!ok){
+            dropDomain(p->st);
+            astClear(&p->ast);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse(Parser *p, const char *src, Token *tokens){
+    p->src = src;
+    p->tkArray = tokens;
+    p->tkArrayPos = 0;
+    return parseTokens(p, false);
+}
+
+bool parseSource(Parser *p, const char *src, bool lexThread){
+    p->src = src;
+    p->tkArray = NULL;
+    return parseTokens(p, lexThread);
+}
@@ -2,17 +2,76 @@
 
 #include "lexer.h"
 #include "ad.h"
+#include "ast.h"
+#include "utils.h"
+#include "pool.h"
 #include "stdbool.h"
 
-// Token iterator used by parser
-extern Token *iTk;        // the iterator in the tokens list
-extern Token *consumedTk; // the last consumed token
+// the state of a compilation
+// several parsers can run at the same time, on different threads, if they have different symbol tables
+typedef struct Parser {
+    SymTable *st;          // the symbol table; the unit's global domain is pushed on it
+    InternPool *names;     // the pool which interns the names of the unit
+    // the AST built by the last parse
+    // it refers to the symbols of the global domain, so it is valid until that domain is dropped
+    Ast ast;
+    Arena texts;           // the texts of the string constants from the AST
+    // the number of times when a token was consumed again after the parser went back to it
+    // the parser decides with a bounded lookahead, so it should be 0
+    int nBacktracks;
+    char errMsg[256];      // the error of the last failed parse
+    // if not NULL, parse analyses the function bodies on this pool (see parse)
+    Pool *pool;
+
+    // Token iterator used by parser
+    int iTk;               // the index of the current token
+    int consumedTk;        // the index of the last consumed token
+    int maxConsumedTk;
+    Symbol *owner;         // the current struct or function
+    const char *src;
+    // the tokens from the current top-level item on, in blocks of TK_BLOCK tokens
+    Token **tkRing;
+    int tkRingSize;
+    int tkFirst;           // the index of the first kept token
+    int tkPulled;          // the number of tokens pulled so far
+    Token *tkArray;        // if not NULL, the tokens come from this array
+    int tkArrayPos;
+    TkStream *stream;      // else they are lexed on demand from this stream
+    // the function bodies of a parallel parse, which are analysed after the rest of the unit
+    struct FnBody *bodies;
+    int nBodies, bodiesCap;
+    // while a function body is analysed in parallel, the symbols of unitDomain from nVisible on
+    // are defined after the function, so they are not visible in its body
+    Domain *unitDomain;
+    int nVisible;
+    Arena lasting;         // the memory of the locals which such a body adds to the list of its function
+} Parser;
+
+void parserInit(Parser *p, SymTable *st, InternPool *names);
+// frees the memory of the parser, including its AST
+void parserFree(Parser *p);
+
+// returns the token with the index i, lexing it if needed
+// only the tokens from the current top-level item on are kept
+Token *tkAt(Parser *p, int i);
 
 // Error reporting function
-void tkerr(const char *fmt,...);
+// it does not return: the error goes to the current parse, which fails
+void tkerr(Parser *p, const char *fmt,...);
 
 // Parser entry point function
-void parse(Token *tokens);
+// src is the source of the tokens, from which their texts are taken
+// on success, the unit's global domain remains pushed on p->st
+// on error, returns false with the message in p->errMsg, and p->st is left as it was
+// if p->pool is set, a first pass parses only the structs, the global variables and the functions' signatures,
+// then the function bodies are analysed in parallel; the result and the first error of the parse are the same as
+// without pool
+// the tokens are given, so a lexical error is found before the parse starts, even if the serial parse of an on-demand
+// lexing (parseSource) would stop earlier, at a syntax or semantic error
+bool parse(Parser *p, const char *src, Token *tokens);
+// the same as parse, but the source is lexed on demand, while it is parsed
+// if lexThread, the lexer runs on its own thread, ahead of the parser
+bool parseSource(Parser *p, const char *src, bool lexThread);
 
 // Unit parsing function
-bool unit();
\ No newline at end of file
+bool unit(Parser *p);
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "pool.h"
+
+struct Pool{
+	pthread_t *workers;
+	int nWorkers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		// signaled when a job starts or the pool stops
+	pthread_cond_t done;		// signaled when the last worker leaves a job
+	// the current job
+	void(*fn)(void *arg,int i);
+	void *arg;
+	int n;
+	atomic_int next;		// the next index to run
+	int generation;		// incremented for each job, so a worker runs each job only once
+	int nBusy;		// the workers still in the current job
+	bool stop;
+	};
+
+// runs the job's indexes until there are no more
+static void runJob(Pool *pool){
+	for(;;){
+		int i=atomic_fetch_add(&pool->next,1);
+		if(i>=pool->n)break;
+		pool->fn(pool->arg,i);
+		}
+	}
+
+static void *workerMain(void *p){
+	Pool *pool=(Pool*)p;
+	int seen=0;
+	pthread_mutex_lock(&pool->lock);
+	for(;;){
+		while(!pool->stop&&pool->generation==seen)pthread_cond_wait(&pool->wake,&pool->lock);
+		if(pool->stop)break;
+		seen=pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		runJob(pool);
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->nBusy==0)pthread_cond_signal(&pool->done);
+		}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+	}
+
+Pool *poolNew(int nThreads){
+	Pool *pool=(Pool*)safeAlloc(sizeof(Pool));
+	pool->nWorkers=nThreads>1?nThreads-1:0;
+	pool->workers=(pthread_t*)safeAlloc((pool->nWorkers+1)*sizeof(pthread_t));
+	pthread_mutex_init(&pool->lock,NULL);
+	pthread_cond_init(&pool->wake,NULL);
+	pthread_cond_init(&pool->done,NULL);
+	pool->generation=0;
+	pool->nBusy=0;
+	pool->stop=false;
+	for(int i=0;i<pool->nWorkers;i++){
+		if(pthread_create(&pool->workers[i],NULL,workerMain,pool))err("cannot create a thread");
+		}
+	return pool;
+	}
+
+void poolFor(Pool *pool,int n,void(*fn)(void *arg,int i),void *arg){
+	pthread_mutex_lock(&pool->lock);
+	pool->fn=fn;
+	pool->arg=arg;
+	pool->n=n;
+	atomic_store(&pool->next,0);
+	pool->nBusy=pool->nWorkers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	runJob(pool);
+	pthread_mutex_lock(&pool->lock);
+	while(pool->nBusy)pthread_cond_wait(&pool->done,&pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	}
+
+int poolThreads(Pool *pool){
+	return pool->nWorkers+1;
+	}
+
+void poolFree(Pool *pool){
+	pthread_mutex_lock(&pool->lock);
+	pool->stop=true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for(int i=0;i<pool->nWorkers;i++)pthread_join(pool->workers[i],NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool);
+	}
+
+int cpuCount(){
+	long n=sysconf(_SC_NPROCESSORS_ONLN);
+	return n>0?(int)n:1;
+	}
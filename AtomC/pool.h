@@ -0,0 +1,21 @@
+#pragma once
+
+// a fixed pool of worker threads
+
+typedef struct Pool Pool;
+
+// creates a pool which runs the jobs on nThreads threads: nThreads-1 workers and the thread which calls poolFor
+Pool *poolNew(int nThreads);
+
+// runs fn(arg,i) for all i in [0,n) and returns after all the calls are done
+// the calls are distributed dynamically, so they can take different times
+void poolFor(Pool *pool,int n,void(*fn)(void *arg,int i),void *arg);
+
+// the number of threads which run the jobs of the pool, including the one which calls poolFor
+int poolThreads(Pool *pool);
+
+// stops the workers and frees the pool
+void poolFree(Pool *pool);
+
+// the number of threads which can run in parallel on this machine
+int cpuCount();
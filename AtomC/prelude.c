@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "ad.h"
+#include "intern.h"
+#include "vm.h"
+#include "prelude.h"
+
+#define PRELUDE_VERSION	1
+
+// the start of a prelude file
+typedef struct{
+	char magic[4];		// "ATCP"
+	uint32_t version;		// PRELUDE_VERSION
+	// the symbols are stored like in memory, so the compiler which loads a file must have the same sizes
+	// as the one which saved it
+	uint32_t symbolSize,domainSize,ptrSize;
+	uint32_t size;		// the size of the file
+	uint32_t domain;		// the offset of the Domain
+	uint32_t names,nNames;		// the offset of the array with the offsets of the names' entries (see internEntry)
+	uint32_t relocs,nRelocs;		// the offset of the array of PreludeReloc
+	}PreludeHdr;
+
+typedef enum{
+	RELOC_PTR,		// a pointer, stored as an offset from the start of the file
+	RELOC_EXT_FN		// an extern function's symbol, whose extFnPtr is found by the symbol's name
+	}RelocKind;
+
+typedef struct{
+	uint32_t offset;		// the position of the pointer or symbol in the file
+	uint32_t kind;		// RelocKind
+	}PreludeReloc;
+
+// the file is built in memory, then written at once
+typedef struct{
+	char *buf;
+	size_t len,cap;
+	// the offsets in buf of the saved symbols, names and domain, by their addresses in memory
+	// open addressing hash table
+	const void **keys;
+	uint32_t *offsets;
+	unsigned mapCap,nMap;
+	Symbol **syms;		// the saved symbols, in the order they were added to buf
+	int nSyms,symsCap;
+	uint32_t *entries;		// the offsets of the names' entries
+	int nEntries,entriesCap;
+	PreludeReloc *relocs;
+	int nRelocs,relocsCap;
+	}Writer;
+
+// makes room for one more element in a vector with *cap elements of elemSize bytes, which has n elements
+static void *grow(void *v,int n,int *cap,size_t elemSize){
+	if(n<*cap)return v;
+	*cap=*cap?*cap*2:256;
+	return safeRealloc(v,*cap*elemSize);
+	}
+
+static unsigned hashPtr(const void *p){
+	return (unsigned)(((uintptr_t)p>>3)*2654435761u);
+	}
+
+// returns the slot of key or, if key is not in the map, the free slot where it can be added
+static unsigned mapSlot(const Writer *w,const void *key){
+	unsigned mask=w->mapCap-1;
+	unsigned i=hashPtr(key)&mask;
+	while(w->keys[i]&&w->keys[i]!=key)i=(i+1)&mask;
+	return i;
+	}
+
+static void mapPut(Writer *w,const void *key,uint32_t offset){
+	if(2*(w->nMap+1)>w->mapCap){
+		const void **keys=w->keys;
+		uint32_t *offsets=w->offsets;
+		unsigned cap=w->mapCap;
+		w->mapCap=cap?cap*2:1024;
+		w->keys=(const void**)safeAlloc(w->mapCap*sizeof(const void*));
+		memset(w->keys,0,w->mapCap*sizeof(const void*));
+		w->offsets=(uint32_t*)safeAlloc(w->mapCap*sizeof(uint32_t));
+		for(unsigned i=0;i<cap;i++){
+			if(!keys[i])continue;
+			unsigned j=mapSlot(w,keys[i]);
+			w->keys[j]=keys[i];
+			w->offsets[j]=offsets[i];
+			}
+		free(keys);
+		free(offsets);
+		}
+	unsigned i=mapSlot(w,key);
+	w->keys[i]=key;
+	w->offsets[i]=offset;
+	w->nMap++;
+	}
+
+// returns the offset of the copy of key, or 0 if key was not saved
+static uint32_t mapGet(const Writer *w,const void *key){
+	if(!w->mapCap)return 0;
+	unsigned i=mapSlot(w,key);
+	return w->keys[i]?w->offsets[i]:0;
+	}
+
+// appends size bytes from data (or zeros if data is NULL), aligned to align (a power of 2), and returns their offset
+static uint32_t put(Writer *w,const void *data,size_t size,size_t align){
+	size_t pos=(w->len+align-1)&~(align-1);
+	if(pos+size>UINT32_MAX)err("the prelude is too large");
+	if(pos+size>w->cap){
+		while(pos+size>w->cap)w->cap=w->cap?w->cap*2:64*1024;
+		w->buf=(char*)safeRealloc(w->buf,w->cap);
+		}
+	memset(w->buf+w->len,0,pos-w->len);
+	if(data)memcpy(w->buf+pos,data,size);
+		else memset(w->buf+pos,0,size);
+	w->len=pos+size;
+	return (uint32_t)pos;
+	}
+
+static void addReloc(Writer *w,size_t offset,RelocKind kind){
+	w->relocs=(PreludeReloc*)grow(w->relocs,w->nRelocs,&w->relocsCap,sizeof(PreludeReloc));
+	w->relocs[w->nRelocs++]=(PreludeReloc){(uint32_t)offset,kind};
+	}
+
+// sets the pointer from buf at pos to the given offset
+static void setOffset(Writer *w,size_t pos,uint32_t offset){
+	uintptr_t v=offset;
+	memcpy(w->buf+pos,&v,sizeof(v));
+	addReloc(w,pos,RELOC_PTR);
+	}
+
+// sets a pointer field of a copy from buf to the copy of target
+// buf must not grow after field was taken from it
+static void setPtr(Writer *w,void *field,const void *target){
+	if(!target){
+		memset(field,0,sizeof(void*));
+		return;
+		}
+	uint32_t offset=mapGet(w,target);
+	if(!offset)err("cannot save the prelude: it uses symbols which are not in its domain");
+	setOffset(w,(char*)field-w->buf,offset);
+	}
+
+static void addName(Writer *w,const char *name){
+	if(mapGet(w,name))return;
+	size_t size;
+	const char *entry=(const char*)internEntry(name,&size);
+	uint32_t offset=put(w,entry,size,8);
+	mapPut(w,name,offset+(uint32_t)(name-entry));
+	w->entries=(uint32_t*)grow(w->entries,w->nEntries,&w->entriesCap,sizeof(uint32_t));
+	w->entries[w->nEntries++]=offset;
+	}
+
+// appends a copy of s and of the symbols and memory which belong to it
+// the pointers from the copy are set later by fixSymbol, after all the symbols have their offsets
+static void addSymbol(Writer *w,Symbol *s){
+	uint32_t offset=put(w,s,sizeof(Symbol),_Alignof(Symbol));
+	mapPut(w,s,offset);
+	w->syms=(Symbol**)grow(w->syms,w->nSyms,&w->symsCap,sizeof(Symbol*));
+	w->syms[w->nSyms++]=s;
+	addName(w,s->name);
+	switch(s->kind){
+		case SK_VAR:
+			if(!s->owner){
+				// the memory of a global variable is saved in the file, after its symbol
+				uint32_t mem=put(w,NULL,typeSize(&s->type),_Alignof(max_align_t));
+				setOffset(w,offset+offsetof(Symbol,varMem),mem);
+				}
+			break;
+		case SK_FN:
+			for(Symbol *param=s->fn.params;param;param=param->next)addSymbol(w,param);
+			break;
+		case SK_STRUCT:{
+			for(Symbol *m=s->structMembers;m;m=m->next)addSymbol(w,m);
+			// its slots are set by fixSymbol
+			uint32_t index=put(w,NULL,(s->structIndexMask+1)*sizeof(Symbol*),_Alignof(Symbol*));
+			setOffset(w,offset+offsetof(Symbol,structIndex),index);
+			}break;
+		default:break;
+		}
+	}
+
+static void fixSymbol(Writer *w,Symbol *s){
+	Symbol *c=(Symbol*)(w->buf+mapGet(w,s));
+	setPtr(w,&c->name,s->name);
+	// the type is set field by field, so its padding is 0 and the same symbols always give the same file
+	memset(&c->type,0,sizeof(Type));
+	c->type.tb=s->type.tb;
+	c->type.n=s->type.n;
+	setPtr(w,&c->type.s,s->type.tb==TB_STRUCT?s->type.s:NULL);
+	setPtr(w,&c->owner,s->owner);
+	setPtr(w,&c->next,s->next);
+	// the domains of the owned symbols are not saved, because they were already dropped
+	// the links of the domains' symbols are set by preludeSave
+	setPtr(w,&c->nextInDomain,NULL);
+	setPtr(w,&c->domain,s->owner?NULL:s->domain);
+	setPtr(w,&c->shadowed,NULL);		// set again when the domain is attached
+	switch(s->kind){
+		case SK_FN:
+			setPtr(w,&c->fn.params,s->fn.params);
+			setPtr(w,&c->fn.locals,NULL);
+			setPtr(w,&c->fn.instr,NULL);
+			c->fn.extFnPtr=NULL;
+			if(s->fn.extFnPtr)addReloc(w,(char*)c-w->buf,RELOC_EXT_FN);
+			break;
+		case SK_STRUCT:{
+			setPtr(w,&c->structMembers,s->structMembers);
+			uintptr_t index;
+			memcpy(&index,&c->structIndex,sizeof(index));
+			for(unsigned i=0;i<=s->structIndexMask;i++){
+				setPtr(w,w->buf+index+i*sizeof(Symbol*),s->structIndex[i]);
+				}
+			}break;
+		default:break;
+		}
+	}
+
+void preludeSave(const char *fileName,const SymTable *st){
+	Writer w;
+	memset(&w,0,sizeof(Writer));
+	put(&w,NULL,sizeof(PreludeHdr),_Alignof(PreludeHdr));
+	uint32_t domain=put(&w,NULL,sizeof(Domain),_Alignof(Domain));
+	// the domains from the outermost one
+	int nDomains=0;
+	for(Domain *d=st->top;d;d=d->parent)nDomains++;
+	Domain **domains=(Domain**)safeAlloc(nDomains*sizeof(Domain*));
+	int i=nDomains;
+	for(Domain *d=st->top;d;d=d->parent)domains[--i]=d;
+	for(i=0;i<nDomains;i++){
+		mapPut(&w,domains[i],domain);
+		for(Symbol *s=domains[i]->symbols;s;s=s->nextInDomain)addSymbol(&w,s);
+		}
+	// all the objects are in buf, so it does not grow anymore until all the pointers are set
+	for(i=0;i<w.nSyms;i++)fixSymbol(&w,w.syms[i]);
+	// the symbols of all the domains are put in a single list, so a symbol from an inner domain is bound after
+	// the ones with the same name from the outer domains and it hides them, like before
+	Domain *c=(Domain*)(w.buf+domain);
+	Symbol *last=NULL;
+	for(i=0;i<nDomains;i++){
+		for(Symbol *s=domains[i]->symbols;s;s=s->nextInDomain){
+			Symbol *copy=(Symbol*)(w.buf+mapGet(&w,s));
+			copy->defIdx=c->nSymbols++;
+			if(last)setPtr(&w,&((Symbol*)(w.buf+mapGet(&w,last)))->nextInDomain,s);
+				else setPtr(&w,&c->symbols,s);
+			last=s;
+			}
+		}
+	setPtr(&w,&c->last,last);
+	free(domains);
+	uint32_t names=put(&w,w.entries,w.nEntries*sizeof(uint32_t),_Alignof(uint32_t));
+	uint32_t relocs=put(&w,w.relocs,w.nRelocs*sizeof(PreludeReloc),_Alignof(PreludeReloc));
+	PreludeHdr hdr={{'A','T','C','P'},PRELUDE_VERSION,sizeof(Symbol),sizeof(Domain),sizeof(void*),
+		(uint32_t)w.len,domain,names,(uint32_t)w.nEntries,relocs,(uint32_t)w.nRelocs};
+	memcpy(w.buf,&hdr,sizeof(hdr));
+	FILE *fis=fopen(fileName,"wb");
+	if(!fis)err("unable to create %s",fileName);
+	size_t n=fwrite(w.buf,1,w.len,fis);
+	if(fclose(fis)||n!=w.len)err("cannot write all the content of %s",fileName);
+	free(w.buf);
+	free(w.keys);
+	free(w.offsets);
+	free(w.syms);
+	free(w.entries);
+	free(w.relocs);
+	}
+
+// the checks of a loaded file, which can be corrupted
+// all the pointers which the compiler follows are checked to be inside the file, with all of their object
+typedef struct{
+	const char *fileName;
+	char *image;
+	size_t size;
+	const uint32_t *entries;		// the offsets of the names' entries, increasing
+	uint32_t nNames;
+	size_t nameSkip;		// the distance from an entry to its name
+	Domain *d;
+	Symbol **syms;		// the symbols of d, by their defIdx
+	}Checker;
+
+static noreturn void corrupted(Checker *c){
+	free(c->syms);
+	err("%s is corrupted",c->fileName);
+	}
+
+// true if the object of size bytes from p is inside the file and it is aligned to align
+static bool inFile(Checker *c,const void *p,size_t size,size_t align){
+	const char *q=(const char*)p;
+	return q>=c->image&&q<=c->image+c->size&&size<=(size_t)(c->image+c->size-q)&&(uintptr_t)q%align==0;
+	}
+
+// true if name is the name of an entry, which was checked by internAdopt
+static bool isName(Checker *c,const char *name){
+	if(!inFile(c,name,1,1)||(size_t)(name-c->image)<c->nameSkip)return false;
+	size_t offset=(size_t)(name-c->image)-c->nameSkip;
+	uint32_t lo=0,hi=c->nNames;
+	while(lo<hi){
+		uint32_t mid=lo+(hi-lo)/2;
+		if(c->entries[mid]==offset)return true;
+		if(c->entries[mid]<offset)lo=mid+1;
+			else hi=mid;
+		}
+	return false;
+	}
+
+static bool isDomainSymbol(Checker *c,const Symbol *s){
+	return inFile(c,s,sizeof(Symbol),_Alignof(Symbol))&&s->defIdx>=0&&s->defIdx<c->d->nSymbols&&c->syms[s->defIdx]==s;
+	}
+
+static void checkType(Checker *c,const Type *t){
+	if((unsigned)t->tb>TB_STRUCT||t->n<-1)corrupted(c);
+	if(t->tb==TB_STRUCT&&!(isDomainSymbol(c,t->s)&&t->s->kind==SK_STRUCT))corrupted(c);
+	}
+
+// the size of a value of type t, which must fit in the file, like all the values of the file
+static size_t valueSize(Checker *c,const Type *t){
+	if(t->n==0)return sizeof(void*);
+	Type base={t->tb,NULL,-1};
+	size_t size;
+	if(t->tb==TB_STRUCT){
+		if(t->s->structSize<0)corrupted(c);
+		size=(size_t)t->s->structSize;
+		}else{
+		size=(size_t)typeSize(&base);
+		}
+	size_t n=t->n>0?(size_t)t->n:1;
+	if(size>c->size/n)corrupted(c);
+	return n*size;
+	}
+
+static void checkSymbol(Checker *c,Symbol *s,Symbol *owner);
+
+// checks a list of symbols of owner, linked by next
+static void checkList(Checker *c,Symbol *list,Symbol *owner,SymKind kind){
+	size_t n=0;
+	for(Symbol *s=list;s;s=s->next){
+		if(++n>c->size/sizeof(Symbol)||!inFile(c,s,sizeof(Symbol),_Alignof(Symbol))||s->kind!=kind)corrupted(c);
+		checkSymbol(c,s,owner);
+		}
+	}
+
+static void checkSymbol(Checker *c,Symbol *s,Symbol *owner){
+	if(!isName(c,s->name)||s->owner!=owner||(unsigned)s->kind>SK_STRUCT)corrupted(c);
+	checkType(c,&s->type);
+	switch(s->kind){
+		case SK_VAR:
+			if(owner){
+				// a member must be inside its struct
+				if(owner->kind!=SK_STRUCT||s->varIdx<0||
+						valueSize(c,&s->type)>(size_t)owner->structSize-s->varIdx)corrupted(c);
+				}else{
+				if(!inFile(c,s->varMem,valueSize(c,&s->type),1))corrupted(c);
+				}
+			break;
+		case SK_PARAM:
+			if(!owner||owner->kind!=SK_FN)corrupted(c);
+			break;
+		case SK_FN:
+			if(owner||s->fn.locals||s->fn.instr)corrupted(c);
+			checkList(c,s->fn.params,s,SK_PARAM);
+			break;
+		case SK_STRUCT:{
+			if(owner||s->structSize<0||s->structAlign<1||s->structAlign>(int)_Alignof(max_align_t)||
+					(s->structAlign&(s->structAlign-1)))corrupted(c);
+			checkList(c,s->structMembers,s,SK_VAR);
+			// a search in the index ends on an empty slot, so there must be one
+			size_t nSlots=(size_t)s->structIndexMask+1;
+			if(!nSlots||(nSlots&(nSlots-1))||nSlots>c->size/sizeof(Symbol*)||
+					!inFile(c,s->structIndex,nSlots*sizeof(Symbol*),_Alignof(Symbol*)))corrupted(c);
+			bool hasEmpty=false;
+			for(size_t i=0;i<nSlots;i++){
+				Symbol *m=s->structIndex[i];
+				if(!m){
+					hasEmpty=true;
+					continue;
+					}
+				if(!inFile(c,m,sizeof(Symbol),_Alignof(Symbol))||m->kind!=SK_VAR)corrupted(c);
+				checkSymbol(c,m,s);
+				}
+			if(!hasEmpty)corrupted(c);
+			}break;
+		}
+	}
+
+// checks the domain and all the symbols of the file, after its pointers were relocated
+static void checkDomain(Checker *c){
+	Domain *d=c->d;
+	if(d->nSymbols<0||(size_t)d->nSymbols>c->size/sizeof(Symbol))corrupted(c);
+	c->syms=(Symbol**)safeAlloc((d->nSymbols+1)*sizeof(Symbol*));
+	int n=0;
+	for(Symbol *s=d->symbols;s;s=s->nextInDomain){
+		if(n==d->nSymbols||!inFile(c,s,sizeof(Symbol),_Alignof(Symbol))||s->domain!=d||s->defIdx!=n)corrupted(c);
+		c->syms[n++]=s;
+		}
+	if(n!=d->nSymbols||d->last!=(n?c->syms[n-1]:NULL))corrupted(c);
+	for(int i=0;i<n;i++)checkSymbol(c,c->syms[i],NULL);
+	// the fields which are not used from the file
+	d->parent=NULL;
+	memset(&d->mark,0,sizeof(d->mark));
+	memset(&d->lasting,0,sizeof(d->lasting));
+	}
+
+void preludeLoad(Prelude *pre,const char *fileName){
+	pre->file=mapFilePrivate(fileName);
+	char *image=(char*)pre->file.data;
+	size_t size=pre->file.size;
+	PreludeHdr *hdr=(PreludeHdr*)image;
+	if(size<sizeof(PreludeHdr)||memcmp(hdr->magic,"ATCP",4)||hdr->version!=PRELUDE_VERSION||
+			hdr->symbolSize!=sizeof(Symbol)||hdr->domainSize!=sizeof(Domain)||hdr->ptrSize!=sizeof(void*)||
+			hdr->size!=size){
+		err("%s is not a prelude of this compiler",fileName);
+		}
+	Checker c={fileName,image,size,(const uint32_t*)(image+hdr->names),hdr->nNames,0,
+		(Domain*)(image+hdr->domain),NULL};
+	if(!inFile(&c,c.d,sizeof(Domain),_Alignof(Domain))||
+			!inFile(&c,c.entries,(size_t)hdr->nNames*sizeof(uint32_t),_Alignof(uint32_t))||
+			!inFile(&c,image+hdr->relocs,(size_t)hdr->nRelocs*sizeof(PreludeReloc),_Alignof(PreludeReloc))){
+		corrupted(&c);
+		}
+	PreludeReloc *relocs=(PreludeReloc*)(image+hdr->relocs);
+	for(uint32_t i=0;i<hdr->nRelocs;i++){
+		if(relocs[i].kind!=RELOC_PTR)continue;
+		uintptr_t offset;
+		if(relocs[i].offset+sizeof(offset)>size)corrupted(&c);
+		memcpy(&offset,image+relocs[i].offset,sizeof(offset));
+		if(offset>=size)corrupted(&c);
+		char *ptr=image+offset;
+		memcpy(image+relocs[i].offset,&ptr,sizeof(ptr));
+		}
+	// after the relocation, which could have changed them
+	internInit(&pre->names,NULL);
+	for(uint32_t i=0;i<c.nNames;i++){
+		if(c.entries[i]>=size||(i&&c.entries[i]<=c.entries[i-1]))corrupted(&c);
+		const char *name=internAdopt(&pre->names,image+c.entries[i],size-c.entries[i]);
+		// a name which is not its entry's own name was in another entry
+		if(!name||(i&&name!=image+c.entries[i]+c.nameSkip))corrupted(&c);
+		c.nameSkip=(size_t)(name-(image+c.entries[i]));
+		}
+	checkDomain(&c);
+	for(uint32_t i=0;i<hdr->nRelocs;i++){
+		if(relocs[i].kind!=RELOC_EXT_FN)continue;
+		Symbol *s=(Symbol*)(image+relocs[i].offset);
+		if(relocs[i].offset>size||!isDomainSymbol(&c,s)||s->kind!=SK_FN)corrupted(&c);
+		s->fn.extFnPtr=vmExtFn(s->name);
+		if(!s->fn.extFnPtr)err("%s: unknown extern function %s",fileName,s->name);
+		}
+	free(c.syms);
+	symTableInit(&pre->st,NULL);
+	attachDomain(&pre->st,c.d);
+	}
+
+void preludeFree(Prelude *pre){
+	detachDomain(&pre->st);
+	symTableFree(&pre->st);
+	internFree(&pre->names);
+	unmapFile(&pre->file);
+	}
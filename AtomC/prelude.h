@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ad.h"
+#include "intern.h"
+
+// the binary preludes: a global domain which is compiled once and saved in a file, like a precompiled header
+// a prelude is loaded at the start of a compilation and it is the base of the unit's symbols table and intern pool,
+// so its symbols are visible in the unit without being analysed again
+// it contains the structs (with their layouts), the extern functions, the functions (only their signatures)
+// and the global variables (with their memory) from the saved domain
+// in the file the pointers are offsets from its start; the file is mapped in memory with private pages and these
+// offsets are relocated when it is loaded, so the symbols and names are not parsed or allocated again
+// the relocation and the binding of the symbols write on every page with pointers, so the system copies these
+// pages (most of the file), but without the costs of parsing and of many small allocations
+// a loaded file is checked, so a corrupted file is rejected instead of being used
+
+typedef struct{
+	InternPool names;		// the names of the prelude, which are in the mapped file
+	SymTable st;		// a table with the domain of the prelude, which is in the mapped file
+	SrcFile file;		// the file, mapped with mapFilePrivate
+	}Prelude;
+
+// saves the symbols of all the domains of st in a prelude file, as a single domain
+// the bases of st are not saved, so all the symbols used by the domains (ex: the structs of their variables)
+// must be in them
+void preludeSave(const char *fileName,const SymTable *st);
+
+// loads a prelude saved by preludeSave
+// after that, pre->names and pre->st can be the bases of the pools and tables of many units; they must not be changed
+void preludeLoad(Prelude *pre,const char *fileName);
+
+// frees a prelude loaded by preludeLoad, after all the units which use it were freed
+void preludeFree(Prelude *pre);
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "scan.h"
+
+const unsigned char scanClass[256] = {
+    0,0,0,0,0,0,0,0,0,4,4,0,0,4,0,0,    // 00
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,    // 10
+    4,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,    // 20
+    2,2,2,2,2,2,2,2,2,2,0,0,0,0,0,0,    // 30
+    0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,    // 40
+    1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,1,    // 50
+    0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,    // 60
+    1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,    // 70
+    // 80-FF: no class
+};
+
+// the scalar kernels
+
+static const char *skipBlanksScalar(const char *p) {
+    while(scanClass[(unsigned char)*p] & CC_BLANK) p++;
+    return p;
+}
+
+static const char *findLineEndScalar(const char *p) {
+    while(*p != '\n' && *p != '\0') p++;
+    return p;
+}
+
+static const char *findQuoteScalar(const char *p) {
+    while(*p != '\"' && *p != '\0') p++;
+    return p;
+}
+
+static const char *skipIdentScalar(const char *p) {
+    while(isIdChar(*p)) p++;
+    return p;
+}
+
+static int countNewlinesScalar(const char *begin, const char *end) {
+    int n = 0;
+    for(; begin != end; begin++) {
+        if(*begin == '\n') n++;
+    }
+    return n;
+}
+
+const char *(*skipBlanks)(const char *p) = skipBlanksScalar;
+const char *(*findLineEnd)(const char *p) = findLineEndScalar;
+const char *(*findQuote)(const char *p) = findQuoteScalar;
+const char *(*skipIdent)(const char *p) = skipIdentScalar;
+int (*countNewlines)(const char *begin, const char *end) = countNewlinesScalar;
+const char *scanIsa = "scalar";
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+
+// Each vector kernel is written once over a block of W bytes and instantiated for SSE2 (W=16) and AVX2 (W=32).
+// A block gives bit masks with one bit for each byte. The loads are aligned, so a load never crosses
+// a page boundary; the bytes before the start pointer are removed from the first mask.
+// So the first and the last block can read bytes outside the source's buffer (before its start or after its '\0'),
+// which cannot fault and are never used. AddressSanitizer would report these reads, so the kernels are not
+// instrumented by it.
+
+#define SSE2    __attribute__((target("sse2"), no_sanitize_address))
+#define AVX2    __attribute__((target("avx2"), no_sanitize_address))
+
+// SSE2 block primitives (16 bytes)
+SSE2 static inline __m128i sse2Load(const char *p) { return _mm_load_si128((const __m128i *)p); }
+SSE2 static inline __m128i sse2LoadU(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+SSE2 static inline unsigned sse2Eq(__m128i v, char c) {
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+// bytes in [lo,lo+n), using the signed compare on values shifted so that lo becomes -128
+SSE2 static inline __m128i sse2Range(__m128i v, char lo, int n) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + n)));
+}
+SSE2 static inline unsigned sse2Ident(__m128i v) {
+    __m128i alpha = sse2Range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+    __m128i digit = sse2Range(v, '0', 10);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+SSE2 static inline unsigned sse2Blank(__m128i v) {
+    return sse2Eq(v, ' ') | sse2Eq(v, '\t') | sse2Eq(v, '\r') | sse2Eq(v, '\n');
+}
+
+// AVX2 block primitives (32 bytes)
+AVX2 static inline __m256i avx2Load(const char *p) { return _mm256_load_si256((const __m256i *)p); }
+AVX2 static inline __m256i avx2LoadU(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+AVX2 static inline unsigned avx2Eq(__m256i v, char c) {
+    return (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+AVX2 static inline __m256i avx2Range(__m256i v, char lo, int n) {
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + n)), shifted);
+}
+AVX2 static inline unsigned avx2Ident(__m256i v) {
+    __m256i alpha = avx2Range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26);
+    __m256i digit = avx2Range(v, '0', 10);
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+}
+AVX2 static inline unsigned avx2Blank(__m256i v) {
+    return avx2Eq(v, ' ') | avx2Eq(v, '\t') | avx2Eq(v, '\r') | avx2Eq(v, '\n');
+}
+
+#define DEFINE_KERNELS(isa, ATTR, W, FULL) \
+ATTR static const char *skipBlanks_##isa(const char *p) { \
+    unsigned skip = (unsigned)((uintptr_t)p & (W - 1)); \
+    const char *a = p - skip; \
+    unsigned valid = (FULL << skip) & FULL; \
+    for(;;) { \
+        unsigned stop = ~isa##Blank(isa##Load(a)) & valid; \
+        if(stop) return a + __builtin_ctz(stop); \
+        a += W; \
+        valid = FULL; \
+    } \
+} \
+ATTR static const char *findLineEnd_##isa(const char *p) { \
+    unsigned skip = (unsigned)((uintptr_t)p & (W - 1)); \
+    const char *a = p - skip; \
+    unsigned valid = (FULL << skip) & FULL; \
+    for(;;) { \
+        __typeof__(isa##Load(a)) v = isa##Load(a); \
+        unsigned stop = (isa##Eq(v, '\n') | isa##Eq(v, '\0')) & valid; \
+        if(stop) return a + __builtin_ctz(stop); \
+        a += W; \
+        valid = FULL; \
+    } \
+} \
+ATTR static const char *findQuote_##isa(const char *p) { \
+    unsigned skip = (unsigned)((uintptr_t)p & (W - 1)); \
+    const char *a = p - skip; \
+    unsigned valid = (FULL << skip) & FULL; \
+    for(;;) { \
+        __typeof__(isa##Load(a)) v = isa##Load(a); \
+        unsigned stop = (isa##Eq(v, '\"') | isa##Eq(v, '\0')) & valid; \
+        if(stop) return a + __builtin_ctz(stop); \
+        a += W; \
+        valid = FULL; \
+    } \
+} \
+ATTR static const char *skipIdent_##isa(const char *p) { \
+    unsigned skip = (unsigned)((uintptr_t)p & (W - 1)); \
+    const char *a = p - skip; \
+    unsigned valid = (FULL << skip) & FULL; \
+    for(;;) { \
+        unsigned stop = ~isa##Ident(isa##Load(a)) & valid; \
+        if(stop) return a + __builtin_ctz(stop); \
+        a += W; \
+        valid = FULL; \
+    } \
+} \
+ATTR static int countNewlines_##isa(const char *begin, const char *end) { \
+    int n = 0; \
+    for(; end - begin >= W; begin += W) { \
+        n += __builtin_popcount(isa##Eq(isa##LoadU(begin), '\n')); \
+    } \
+    return n + countNewlinesScalar(begin, end); \
+}
+
+DEFINE_KERNELS(sse2, SSE2, 16, 0xFFFFu)
+DEFINE_KERNELS(avx2, AVX2, 32, 0xFFFFFFFFu)
+
+#endif
+
+static void selectKernels() {
+#ifdef SCAN_X86
+    const char *limit = getenv("ATOMC_SCAN");
+    if(limit && !strcmp(limit, "scalar")) return;
+    __builtin_cpu_init();
+    bool useAvx2 = __builtin_cpu_supports("avx2") && !(limit && !strcmp(limit, "sse2"));
+    if(useAvx2) {
+        skipBlanks = skipBlanks_avx2;
+        findLineEnd = findLineEnd_avx2;
+        findQuote = findQuote_avx2;
+        skipIdent = skipIdent_avx2;
+        countNewlines = countNewlines_avx2;
+        scanIsa = "avx2";
+    } else if(__builtin_cpu_supports("sse2")) {
+        skipBlanks = skipBlanks_sse2;
+        findLineEnd = findLineEnd_sse2;
+        findQuote = findQuote_sse2;
+        skipIdent = skipIdent_sse2;
+        countNewlines = countNewlines_sse2;
+        scanIsa = "sse2";
+    }
+#endif
+}
+
+void scanInit() {
+    // the lexers of many threads can start at the same time
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, selectKernels);
+}
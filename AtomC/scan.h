@@ -0,0 +1,44 @@
+#pragma once
+
+// scanning kernels used by the lexer
+// all the kernels work on a '\0' terminated source and never read past the 16 or 32 bytes aligned block
+// which contains the final '\0', so they are safe both for loaded and for mapped files
+// each kernel has a portable scalar version and, on x86, SSE2 and AVX2 versions selected at runtime
+
+// the classes of the chars, as bits in scanClass
+enum {
+    CC_ALPHA = 1,     // a-z A-Z _
+    CC_DIGIT = 2,     // 0-9
+    CC_BLANK = 4      // space, \t, \r, \n
+};
+
+// the class of each char, independent of locale
+extern const unsigned char scanClass[256];
+
+#define isIdStart(c)    (scanClass[(unsigned char)(c)] & CC_ALPHA)
+#define isIdChar(c)     (scanClass[(unsigned char)(c)] & (CC_ALPHA | CC_DIGIT))
+#define isDigit(c)      (scanClass[(unsigned char)(c)] & CC_DIGIT)
+
+// returns a pointer to the first char which is not blank
+// the lines are not counted here, but by countNewlines over the whole match
+extern const char *(*skipBlanks)(const char *p);
+
+// returns a pointer to the first '\n' or '\0' (the end of a // comment)
+extern const char *(*findLineEnd)(const char *p);
+
+// returns a pointer to the first '"' or '\0' (the end of a string literal)
+extern const char *(*findQuote)(const char *p);
+
+// returns a pointer to the first char which is not a letter, digit or _
+extern const char *(*skipIdent)(const char *p);
+
+// returns the number of '\n' in [begin,end)
+extern int (*countNewlines)(const char *begin, const char *end);
+
+// selects the fastest kernels supported by the CPU; it can be called many times, from any thread
+// the environment variable ATOMC_SCAN=scalar|sse2|avx2 can limit the selection (ex: for benchmarks)
+// before this call the scalar kernels are used
+void scanInit();
+
+// the name of the selected kernels: "scalar", "sse2" or "avx2"
+extern const char *scanIsa;
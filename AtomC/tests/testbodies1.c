@@ -0,0 +1,3 @@
+// a body analysed in parallel must not see the parameters of a function whose signature has an error
+int f(){ return x; }
+void g(int x)
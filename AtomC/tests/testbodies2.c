@@ -0,0 +1,3 @@
+// a body analysed in parallel must not see the members of a struct whose definition has an error
+int f(){ return x; }
+struct S{ int x; int y };
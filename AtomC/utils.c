@@ -1,26 +1,160 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+
+#if defined(__unix__)||defined(__APPLE__)
+#define HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "utils.h"
 
+static _Thread_local ErrHandler *errHandlers;		// the last pushed handler of the current thread
+
+void errPush(ErrHandler *h){
+	h->prev=errHandlers;
+	errHandlers=h;
+	}
+
+void errPop(ErrHandler *h){
+	errHandlers=h->prev;
+	}
+
+void errThrow(const char *msg){
+	ErrHandler *h=errHandlers;
+	if(!h){
+		fprintf(stderr,"%s\n",msg);
+		exit(EXIT_FAILURE);
+		}
+	snprintf(h->msg,sizeof(h->msg),"%s",msg);
+	errHandlers=h->prev;
+	longjmp(h->env,1);
+	}
+
 void err(const char *fmt,...){
-	fprintf(stderr,"error: ");
+	char msg[256];
+	int n=snprintf(msg,sizeof(msg),"error: ");
 	va_list va;
 	va_start(va,fmt);
-	vfprintf(stderr,fmt,va);
+	vsnprintf(msg+n,sizeof(msg)-n,fmt,va);
 	va_end(va);
-	fprintf(stderr,"\n");
-	exit(EXIT_FAILURE);
+	errThrow(msg);
+	}
+
+#ifdef COUNT_ALLOCS
+atomic_size_t nAllocs;
+atomic_size_t nAllocBytes;
+
+static void countAlloc(size_t nBytes){
+	atomic_fetch_add_explicit(&nAllocs,1,memory_order_relaxed);
+	atomic_fetch_add_explicit(&nAllocBytes,nBytes,memory_order_relaxed);
 	}
+#else
+#define countAlloc(nBytes)
+#endif
 
 void *safeAlloc(size_t nBytes){
 	void *p=malloc(nBytes);
 	if(!p)err("not enough memory");
+	countAlloc(nBytes);
 	return p;
 	}
 
-char *loadFile(const char *fileName){
+void *safeRealloc(void *p,size_t nBytes){
+	p=realloc(p,nBytes);
+	if(!p)err("not enough memory");
+	countAlloc(nBytes);
+	return p;
+	}
+
+#define ARENA_CHUNK_SIZE	(64*1024)
+
+struct ArenaChunk{
+	ArenaChunk *prev;		// the previous allocated chunk
+	size_t size;		// the size of data
+	_Alignas(max_align_t) char data[];
+	};
+
+// allocates nBytes from the arena, aligned to "align" (a power of 2)
+static void *arenaGet(Arena *a,size_t nBytes,size_t align){
+	size_t pos=(a->used+align-1)&~(align-1);
+	if(!a->chunk||pos+nBytes>a->chunk->size){
+		size_t size=nBytes>ARENA_CHUNK_SIZE?nBytes:ARENA_CHUNK_SIZE;
+		ArenaChunk *c;
+		if(a->spare&&size==ARENA_CHUNK_SIZE){
+			c=a->spare;
+			a->spare=NULL;
+			}else{
+			c=(ArenaChunk*)safeAlloc(sizeof(ArenaChunk)+size);
+			}
+		c->prev=a->chunk;
+		c->size=size;
+		a->chunk=c;
+		pos=0;
+		}
+	a->used=pos+nBytes;
+	return a->chunk->data+pos;
+	}
+
+void *arenaAlloc(Arena *a,size_t nBytes){
+	return arenaGet(a,nBytes,_Alignof(max_align_t));
+	}
+
+char *arenaStrdup(Arena *a,const char *begin,const char *end){
+	size_t n=(size_t)(end-begin);
+	char *s=(char*)arenaGet(a,n+1,1);
+	memcpy(s,begin,n);
+	s[n]='\0';
+	return s;
+	}
+
+void arenaFree(Arena *a){
+	for(ArenaChunk *prev;a->chunk;a->chunk=prev){
+		prev=a->chunk->prev;
+		free(a->chunk);
+		}
+	free(a->spare);
+	a->spare=NULL;
+	a->used=0;
+	}
+
+ArenaMark arenaMark(Arena *a){
+	return (ArenaMark){a->chunk,a->used};
+	}
+
+void arenaRelease(Arena *a,ArenaMark mark){
+	while(a->chunk!=mark.chunk){
+		ArenaChunk *c=a->chunk;
+		a->chunk=c->prev;
+		if(!a->spare&&c->size==ARENA_CHUNK_SIZE)a->spare=c;
+			else free(c);
+		}
+	a->used=mark.used;
+	}
+
+void arenaMerge(Arena *dst,Arena *src){
+	if(src->chunk){
+		if(dst->chunk){
+			// the chunks of src are put under the current chunk of dst, which is not full
+			ArenaChunk *first=src->chunk;
+			while(first->prev)first=first->prev;
+			first->prev=dst->chunk->prev;
+			dst->chunk->prev=src->chunk;
+			}else{
+			dst->chunk=src->chunk;
+			dst->used=src->used;
+			}
+		src->chunk=NULL;
+		}
+	arenaFree(src);
+	}
+
+// loads a file and sets in *size its size
+static char *readFile(const char *fileName,size_t *size){
 	FILE *fis=fopen(fileName,"rb");
 	if(!fis)err("unable to open %s",fileName);
 	fseek(fis,0,SEEK_END);
@@ -31,5 +165,71 @@ char *loadFile(const char *fileName){
 	fclose(fis);
 	if(n!=nRead)err("cannot read all the content of %s",fileName);
 	buf[n]='\0';
+	*size=n;
 	return buf;
 	}
+
+char *loadFile(const char *fileName){
+	size_t n;
+	return readFile(fileName,&n);
+	}
+
+SrcFile mapFile(const char *fileName){
+#ifdef HAVE_MMAP
+	int fd=open(fileName,O_RDONLY);
+	if(fd<0)err("unable to open %s",fileName);
+	struct stat st;
+	if(fstat(fd,&st)<0){
+		close(fd);
+		err("unable to stat %s",fileName);
+		}
+	size_t n=(size_t)st.st_size;
+	// the bytes after the end of file up to the page end are set to 0 by mmap, so they give the final '\0'
+	// when the file fills its last page completely there is no such byte, so the file is loaded normally
+	if(n>0&&n%(size_t)sysconf(_SC_PAGESIZE)!=0){
+		void *p=mmap(NULL,n,PROT_READ,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(p==MAP_FAILED)err("unable to map %s",fileName);
+		return (SrcFile){(const char*)p,n,true};
+		}
+	close(fd);
+#endif
+	size_t size;
+	char *buf=readFile(fileName,&size);
+	return (SrcFile){buf,size,false};
+	}
+
+SrcFile mapFilePrivate(const char *fileName){
+#ifdef HAVE_MMAP
+	int fd=open(fileName,O_RDONLY);
+	if(fd<0)err("unable to open %s",fileName);
+	struct stat st;
+	if(fstat(fd,&st)<0){
+		close(fd);
+		err("unable to stat %s",fileName);
+		}
+	size_t n=(size_t)st.st_size;
+	if(n>0){
+		void *p=mmap(NULL,n,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+		close(fd);
+		if(p==MAP_FAILED)err("unable to map %s",fileName);
+		return (SrcFile){(const char*)p,n,true};
+		}
+	close(fd);
+#endif
+	size_t size;
+	char *buf=readFile(fileName,&size);
+	return (SrcFile){buf,size,false};
+	}
+
+void unmapFile(SrcFile *f){
+#ifdef HAVE_MMAP
+	if(f->mapped){
+		munmap((void*)f->data,f->size);
+		f->data=NULL;
+		return;
+		}
+#endif
+	free((void*)f->data);
+	f->data=NULL;
+	}
@@ -3,17 +3,104 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <stdnoreturn.h>
+#include <stdatomic.h>
+#include <setjmp.h>
 
 // prints to stderr a message prefixed with "error: " and exit the program
+// if the current thread has an error handler, it jumps to that handler instead (see ErrHandler)
 // the arguments are the same as for printf
 noreturn void err(const char *fmt,...);
 
+// an error handler, which catches the errors of the current thread, so they end a compilation but not the program
+// the handlers of a thread are a stack, and an error jumps to the last pushed one
+// usage:
+//		ErrHandler h;
+//		errPush(&h);
+//		if(setjmp(h.env)){
+//			// error: h is already popped and h.msg has the message
+//			}
+//		... (the code which can have errors)
+//		errPop(&h);
+typedef struct ErrHandler{
+	jmp_buf env;
+	struct ErrHandler *prev;
+	char msg[256];		// the message, as it would be printed by err (without "\n")
+	}ErrHandler;
+
+void errPush(ErrHandler *h);
+// pops h, which must be the last pushed handler
+void errPop(ErrHandler *h);
+// jumps to the last pushed handler with msg or, if there is no handler, prints msg to stderr and exit the program
+noreturn void errThrow(const char *msg);
+
 // allocs memory using malloc
 // if succeeds, it returns the allocated memory, else it prints an error message and exit the program
 void *safeAlloc(size_t nBytes);
 
+// reallocs memory using realloc
+// if succeeds, it returns the reallocated memory, else it prints an error message and exit the program
+void *safeRealloc(void *p,size_t nBytes);
+
+#ifdef COUNT_ALLOCS
+// the number of calls of safeAlloc and safeRealloc and the total of their nBytes, for benchmarks
+// they are counted only in the builds with COUNT_ALLOCS defined, so the compiler does not pay for them
+extern atomic_size_t nAllocs;
+extern atomic_size_t nAllocBytes;
+#endif
+
+// a bump allocator which allocates from big chunks of memory
+// the allocated memory is never moved, so the returned pointers remain valid until arenaFree
+typedef struct ArenaChunk ArenaChunk;
+typedef struct{
+	ArenaChunk *chunk;		// the current chunk (the head of the chunks list)
+	size_t used;		// the number of bytes used from the current chunk
+	ArenaChunk *spare;		// a released chunk, kept for the next allocations
+	}Arena;
+
+// a position in an arena, to which the arena can be released
+typedef struct{
+	ArenaChunk *chunk;
+	size_t used;
+	}ArenaMark;
+
+// allocates nBytes from the arena, aligned for any type
+void *arenaAlloc(Arena *a,size_t nBytes);
+// copies the chars from [begin,end) in the arena and adds '\0' at the end
+char *arenaStrdup(Arena *a,const char *begin,const char *end);
+// frees all the memory of the arena at once
+void arenaFree(Arena *a);
+// returns the current position of the arena
+ArenaMark arenaMark(Arena *a);
+// frees at once all the memory allocated after mark, so an arena can be used as a stack
+// a freed chunk is kept for reuse, so pushing and releasing repeatedly at a chunk's end does not call malloc/free
+void arenaRelease(Arena *a,ArenaMark mark);
+// moves all the memory of src to dst, so it is freed with dst; src remains empty
+void arenaMerge(Arena *dst,Arena *src);
+
 // loads a text file in a dynamically allocated memory and returns it
 // on error, prints a message and exit the program
 char *loadFile(const char *fileName);
 
+
+// a source file loaded in memory
+typedef struct{
+	const char *data;		// the file content, always followed by '\0'
+	size_t size;		// the file size
+	bool mapped;		// true if data is a memory mapping, false if it was loaded with loadFile
+	}SrcFile;
+
+// maps a text file read-only in memory, without copying it
+// if the file cannot be mapped with a '\0' after its content (ex: its size is a multiple of the page size
+// or the platform has no mmap), it falls back to loadFile
+// on error, prints a message and exit the program
+SrcFile mapFile(const char *fileName);
+
+// maps a binary file in memory with private pages, which can be changed without changing the file
+// only the changed pages are copied; the data has no '\0' after it
+// if the platform has no mmap, it loads the file in allocated memory
+SrcFile mapFilePrivate(const char *fileName);
+
+// releases the memory of a file loaded with mapFile or mapFilePrivate
+void unmapFile(SrcFile *f);
@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "utils.h"
 #include "ad.h"
+#include "intern.h"
 
 Instr *addInstr(Instr **list,Opcode op){
 	Instr *i=(Instr*)safeAlloc(sizeof(Instr));
@@ -29,122 +31,145 @@ Instr *addInstrWithDouble(Instr **list,Opcode op,double argVal){
 	return i;
 	}
 
-Val stack[10000];		// the stack
-Val *SP=stack-1;		// Stack pointer - the stack's top - points to the value from the top of the stack
-Val *FP=NULL;		// the initial value doesn't matter
+void pushv(Vm *vm,Val v){
+	if(vm->SP+1==vm->stack+10000)err("trying to push into a full stack");
+	*++vm->SP=v;
+	}
 
-void pushv(Val v){
-	if(SP+1==stack+10000)err("trying to push into a full stack");
-	*++SP=v;
+Val popv(Vm *vm){
+	if(vm->SP==vm->stack-1)err("trying to pop from empty stack");
+	return *vm->SP--;
 	}
 
-Val popv(){
-	if(SP==stack-1)err("trying to pop from empty stack");
-	return *SP--;
+void pushi(Vm *vm,int i){
+	if(vm->SP+1==vm->stack+10000)err("trying to push into a full stack");
+	(++vm->SP)->i=i;
 	}
 
-void pushi(int i){
-	if(SP+1==stack+10000)err("trying to push into a full stack");
-	(++SP)->i=i;
+int popi(Vm *vm){
+	if(vm->SP==vm->stack-1)err("trying to pop from empty stack");
+	return vm->SP--->i;
 	}
 
-int popi(){
-	if(SP==stack-1)err("trying to pop from empty stack");
-	return SP--->i;
+void pushp(Vm *vm,void *p){
+	if(vm->SP+1==vm->stack+10000)err("trying to push into a full stack");
+	(++vm->SP)->p=p;
 	}
 
-void pushp(void *p){
-	if(SP+1==stack+10000)err("trying to push into a full stack");
-	(++SP)->p=p;
+void *popp(Vm *vm){
+	if(vm->SP==vm->stack-1)err("trying to pop from empty stack");
+	return vm->SP--->p;
 	}
 
-void *popp(){
-	if(SP==stack-1)err("trying to pop from empty stack");
-	return SP--->p;
+void put_i(Vm *vm){
+	printf("=> %d",popi(vm));
 	}
 
-void put_i(){
-	printf("=> %d",popi());
+#define MAX_EXT_PARAMS	4
+
+// the extern functions, which are declared by vmInit and found by name by vmExtFn
+static const struct{
+	const char *name;
+	void(*fn)();
+	Type ret;
+	struct{
+		const char *name;		// NULL after the last parameter
+		Type type;
+		}params[MAX_EXT_PARAMS];
+	}extFns[]={
+	{"put_i",put_i,{TB_VOID,NULL,-1},{{"i",{TB_INT,NULL,-1}}}}
+	};
+
+void vmInit(SymTable *st,InternPool *names){
+	for(size_t i=0;i<sizeof(extFns)/sizeof(extFns[0]);i++){
+		Symbol *fn=addExtFn(st,internStr(names,extFns[i].name),extFns[i].fn,extFns[i].ret);
+		for(int j=0;j<MAX_EXT_PARAMS&&extFns[i].params[j].name;j++){
+			addFnParam(fn,internStr(names,extFns[i].params[j].name),extFns[i].params[j].type);
+			}
+		}
 	}
 
-void vmInit(){
-	Symbol *fn=addExtFn("put_i",put_i,(Type){TB_VOID,NULL,-1});
-	addFnParam(fn,"i",(Type){TB_INT,NULL,-1});
+void(*vmExtFn(const char *name))(){
+	for(size_t i=0;i<sizeof(extFns)/sizeof(extFns[0]);i++){
+		if(!strcmp(extFns[i].name,name))return extFns[i].fn;
+		}
+	return NULL;
 	}
 
-void run(Instr *IP){
+void run(Vm *vm,Instr *IP){
 	Val v;
 	int iArg,iTop,iBefore;
 	void(*extFnPtr)();
+	vm->SP=vm->stack-1;
 	for(;;){
 		// shows the index of the current instruction and the number of values from stack
-		printf("%p/%d\t",IP,(int)(SP-stack+1));
+		printf("%p/%d\t",IP,(int)(vm->SP-vm->stack+1));
 		switch(IP->op){
 			case OP_HALT:
 				printf("HALT");
 				return;
 			case OP_PUSH_I:
 				printf("PUSH.i\t%d",IP->arg.i);
-				pushi(IP->arg.i);
+				pushi(vm,IP->arg.i);
 				IP=IP->next;
 				break;
 			case OP_CALL:
-				pushp(IP->next);
+				pushp(vm,IP->next);
 				printf("CALL\t%p",IP->arg.instr);
 				IP=IP->arg.instr;
 				break;
 			case OP_CALL_EXT:
 				extFnPtr=IP->arg.extFnPtr;
 				printf("CALL_EXT\t%p\n",extFnPtr);
-				extFnPtr();
+				extFnPtr(vm);
 				IP=IP->next;
 				break;
 			case OP_ENTER:
-				pushp(FP);
-				FP=SP;
-				SP+=IP->arg.i;
+				pushp(vm,vm->FP);
+				vm->FP=vm->SP;
+				vm->SP+=IP->arg.i;
 				printf("ENTER\t%d",IP->arg.i);
 				IP=IP->next;
 				break;
 			case OP_RET_VOID:
 				iArg=IP->arg.i;
 				printf("RET_VOID\t%d",iArg);
-				IP=FP[-1].p;
-				SP=FP-iArg-2;
-				FP=FP[0].p;
+				IP=vm->FP[-1].p;
+				vm->SP=vm->FP-iArg-2;
+				vm->FP=vm->FP[0].p;
 				break;
 			case OP_JMP:
 				printf("JMP\t%p",IP->arg.instr);
 				IP=IP->arg.instr;
 				break;
 			case OP_JF:
-				iTop=popi();
+				iTop=popi(vm);
 				printf("JF\t%p\t// %d",IP->arg.instr,iTop);
 				IP=iTop ? IP->next : IP->arg.instr;
 				break;
 			case OP_FPLOAD:
-				v=FP[IP->arg.i];
-				pushv(v);
+				v=vm->FP[IP->arg.i];
+				pushv(vm,v);
 				printf("FPLOAD\t%d\t// i:%d, f:%g",IP->arg.i,v.i,v.f);
 				IP=IP->next;
 				break;
 			case OP_FPSTORE:
-				v=popv();
-				FP[IP->arg.i]=v;
+				v=popv(vm);
+				vm->FP[IP->arg.i]=v;
 				printf("FPSTORE\t%d\t// i:%d, f:%g",IP->arg.i,v.i,v.f);
 				IP=IP->next;
 				break;
 			case OP_ADD_I:
-				iTop=popi();
-				iBefore=popi();
-				pushi(iBefore+iTop);
+				iTop=popi(vm);
+				iBefore=popi(vm);
+				pushi(vm,iBefore+iTop);
 				printf("ADD.i\t// %d+%d -> %d",iBefore,iTop,iBefore+iTop);
 				IP=IP->next;
 				break;
 			case OP_LESS_I:
-				iTop=popi();
-				iBefore=popi();
-				pushi(iBefore<iTop);
+				iTop=popi(vm);
+				iBefore=popi(vm);
+				pushi(vm,iBefore<iTop);
 				printf("LESS.i\t// %d<%d -> %d",iBefore,iTop,iBefore<iTop);
 				IP=IP->next;
 				break;
@@ -164,7 +189,7 @@ void f(int n){		// stack frame: n[-2] ret[-1] oldFP[0] i[1]
 		}
 	}
 */
-Instr *genTestProgram(){
+Instr *genTestProgram(SymTable *st,InternPool *names){
 	Instr *code=NULL;
 	addInstrWithInt(&code,OP_PUSH_I,2);
 	Instr *callPos=addInstr(&code,OP_CALL);
@@ -180,7 +205,7 @@ Instr *genTestProgram(){
 	Instr *jfAfter=addInstr(&code,OP_JF);
 	// put_i(i);
 	addInstrWithInt(&code,OP_FPLOAD,1);
-	Symbol *s=findSymbol("put_i");
+	Symbol *s=findSymbol(st,internStr(names,"put_i"));
 	if(!s)err("undefined: put_i");
 	addInstr(&code,OP_CALL_EXT)->arg.extFnPtr=s->fn.extFnPtr;
 	// i=i+1;
@@ -59,11 +59,24 @@ Instr *addInstrWithInt(Instr **list,Opcode op,int argVal);
 // add an instruction which has an argument of type double
 Instr *addInstrWithDouble(Instr **list,Opcode op,double argVal);
 
-// MV initialisation
-void vmInit();
+// the state of a virtual machine
+// each thread which runs code needs its own
+typedef struct{
+	Val stack[10000];		// the stack
+	Val *SP;		// Stack pointer - the stack's top - points to the value from the top of the stack
+	Val *FP;
+	}Vm;
 
-// executes the code starting with the given instruction (IP - Instruction Pointer)
-void run(Instr *IP);
+struct SymTable;struct InternPool;
+
+// MV initialisation: adds the extern functions in the current domain of st, with their names from names
+// the extern functions are in a single table in vm.c, which is also used by vmExtFn
+void vmInit(struct SymTable *st,struct InternPool *names);
+// returns the host function of the extern function with the given name, or NULL if there is no such function
+void(*vmExtFn(const char *name))();
+
+// executes the code starting with the given instruction (IP - Instruction Pointer), on vm with an empty stack
+void run(Vm *vm,Instr *IP);
 
 // generates a test program
-Instr *genTestProgram();
+Instr *genTestProgram(struct SymTable *st,struct InternPool *names);